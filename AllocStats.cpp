@@ -0,0 +1,86 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "AllocStats.h"
+
+static std::atomic<uint64_t> allocations[AllocStats::N_STAGES];
+static std::atomic<uint64_t> bytes[AllocStats::N_STAGES];
+static thread_local AllocStats::Stage currentStage = AllocStats::OTHER;
+
+AllocStats::Scope::Scope(Stage stage) : previous(currentStage) {
+    currentStage = stage;
+}
+
+AllocStats::Scope::~Scope() {
+    currentStage = previous;
+}
+
+AllocStats::Counters AllocStats::get(Stage stage) {
+    return {allocations[stage].load(std::memory_order_relaxed), bytes[stage].load(std::memory_order_relaxed)};
+}
+
+const char *AllocStats::name(Stage stage) {
+    static const char *names[N_STAGES] = {"other", "load", "vertex", "raster", "output"};
+    return names[stage];
+}
+
+void AllocStats::reset() {
+    for (int i = 0; i < N_STAGES; ++i) {
+        allocations[i] = 0;
+        bytes[i] = 0;
+    }
+}
+
+void AllocStats::record(size_t size) {
+    allocations[currentStage].fetch_add(1, std::memory_order_relaxed);
+    bytes[currentStage].fetch_add(size, std::memory_order_relaxed);
+}
+
+void AllocStats::report(std::ostream &s) {
+    for (int i = 0; i < N_STAGES; ++i) {
+        Counters c = get(static_cast<Stage>(i));
+        s << "# allocations " << name(static_cast<Stage>(i)) << ": " << c.allocations << " (" << c.bytes
+          << " bytes)\n";
+    }
+}
+
+void *operator new(size_t size) {
+    AllocStats::record(size);
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    AllocStats::record(size);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
@@ -0,0 +1,47 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_ALLOCSTATS_H
+#define SIMPLESOFTWARERENDERER_ALLOCSTATS_H
+
+#include <cstdint>
+#include <iostream>
+
+// Counts every operator new of the process, attributed to the pipeline stage the calling thread is in.
+// Stages are entered with the RAII Scope; allocations outside any scope are counted as OTHER.
+class AllocStats {
+public:
+    enum Stage {
+        OTHER, LOAD, VERTEX, RASTER, OUTPUT, N_STAGES
+    };
+
+    struct Counters {
+        uint64_t allocations;
+        uint64_t bytes;
+    };
+
+    class Scope {
+        Stage previous;
+    public:
+        explicit Scope(Stage stage);
+
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    static Counters get(Stage stage);
+
+    static const char *name(Stage stage);
+
+    static void reset();
+
+    static void record(size_t bytes);
+
+    static void report(std::ostream &s);
+};
+
+#endif //SIMPLESOFTWARERENDERER_ALLOCSTATS_H
@@ -0,0 +1,96 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include "Arena.h"
+
+FrameArena::FrameArena(size_t capacity) : blocks(), sizes(), offset(0), used(0) {
+    blocks.reserve(8);
+    sizes.reserve(8);
+    blocks.push_back(new uint8_t[capacity]);
+    sizes.push_back(capacity);
+}
+
+FrameArena::~FrameArena() {
+    for (uint8_t *block : blocks)
+        delete[] block;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+    auto base = reinterpret_cast<uintptr_t>(blocks.back());
+    size_t aligned = ((base + offset + alignment - 1) & ~(alignment - 1)) - base;
+    if (aligned + bytes > sizes.back()) {
+        size_t size = std::max(bytes + alignment, sizes.back() * 2);
+        blocks.push_back(new uint8_t[size]);
+        sizes.push_back(size);
+        base = reinterpret_cast<uintptr_t>(blocks.back());
+        aligned = ((base + alignment - 1) & ~(alignment - 1)) - base;
+    }
+
+    offset = aligned + bytes;
+    used += bytes;
+    return blocks.back() + aligned;
+}
+
+void FrameArena::reset() {
+    if (blocks.size() > 1) {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            total += sizes[i];
+            delete[] blocks[i];
+        }
+        blocks.clear();
+        sizes.clear();
+        blocks.push_back(new uint8_t[total]);
+        sizes.push_back(total);
+    }
+    offset = 0;
+    used = 0;
+}
+
+size_t FrameArena::get_capacity() const {
+    size_t total = 0;
+    for (size_t size : sizes)
+        total += size;
+    return total;
+}
+
+size_t FrameArena::get_used() const {
+    return used;
+}
+
+FixedPool::FixedPool(size_t blockSize, size_t blocksPerSlab) : blockSize(std::max(blockSize, sizeof(FreeBlock))),
+                                                               blocksPerSlab(std::max<size_t>(blocksPerSlab, 1)),
+                                                               slabs(), freeList(nullptr) {
+    // keep every block aligned like the slab itself
+    const size_t alignment = alignof(std::max_align_t);
+    this->blockSize = (this->blockSize + alignment - 1) & ~(alignment - 1);
+}
+
+FixedPool::~FixedPool() {
+    for (uint8_t *slab : slabs)
+        delete[] slab;
+}
+
+void *FixedPool::allocate() {
+    if (!freeList) {
+        auto *slab = new uint8_t[blockSize * blocksPerSlab];
+        slabs.push_back(slab);
+        for (size_t i = 0; i < blocksPerSlab; ++i)
+            deallocate(slab + i * blockSize);
+    }
+    FreeBlock *block = freeList;
+    freeList = block->next;
+    return block;
+}
+
+void FixedPool::deallocate(void *block) {
+    auto *freeBlock = static_cast<FreeBlock *>(block);
+    freeBlock->next = freeList;
+    freeList = freeBlock;
+}
+
+size_t FixedPool::get_block_size() const {
+    return blockSize;
+}
@@ -0,0 +1,110 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_ARENA_H
+#define SIMPLESOFTWARERENDERER_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Frame-scoped bump allocator. Everything allocated during a frame is released at once by reset().
+// When a frame needs more than the current block the arena chains extra blocks and merges them into
+// a single block on the next reset(), so after the first frames it stops touching the heap.
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity = size_t(1) << 20);
+
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template<class T>
+    T *allocate(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+        T *p = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; ++i)
+            new(p + i) T();
+        return p;
+    }
+
+    void reset();
+
+    size_t get_capacity() const;
+
+    size_t get_used() const;
+
+private:
+    std::vector<uint8_t *> blocks;
+    std::vector<size_t> sizes;
+    size_t offset;   // in the last block
+    size_t used;     // bytes handed out since the last reset()
+};
+
+// Free-list pool of equally sized blocks, for scratch buffers that are recycled every frame.
+// Blocks are carved from slabs that are only given back when the pool dies. Not thread-safe.
+class FixedPool {
+public:
+    FixedPool(size_t blockSize, size_t blocksPerSlab = 16);
+
+    ~FixedPool();
+
+    FixedPool(const FixedPool &) = delete;
+
+    FixedPool &operator=(const FixedPool &) = delete;
+
+    void *allocate();
+
+    void deallocate(void *block);
+
+    size_t get_block_size() const;
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    size_t blockSize;
+    size_t blocksPerSlab;
+    std::vector<uint8_t *> slabs;
+    FreeBlock *freeList;
+};
+
+// std::vector allocator starting every buffer on a cache line, for render targets addressed in cache-line blocks
+template<class T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+
+    CacheAlignedAllocator() = default;
+
+    template<class U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, std::max<size_t>(n * sizeof(T), 1)))
+            throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) {
+        free(p);
+    }
+};
+
+template<class T, class U>
+bool operator==(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return true; }
+
+template<class T, class U>
+bool operator!=(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return false; }
+
+#endif //SIMPLESOFTWARERENDERER_ARENA_H
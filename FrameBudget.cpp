@@ -0,0 +1,76 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "FrameBudget.h"
+
+// aim below the budget so the usual frame to frame noise still fits
+static const double headroom = .85;
+// weight of the newest frame in the cost estimate when frames get cheaper
+static const double smoothing = .3;
+static const float scaleStep = 1.f / 32;
+static const float minChange = 1.f / 16;
+
+FrameBudget::FrameBudget(double budgetSeconds, float minScale, int maxLod) : budget(budgetSeconds),
+                                                                               minScale(minScale), maxLod(maxLod),
+                                                                               scale(1), lod(0), costPerArea(-1),
+                                                                               fixedCost(0), hits(0), history() {}
+
+float FrameBudget::get_scale() const {
+    return scale;
+}
+
+int FrameBudget::get_lod() const {
+    return lod;
+}
+
+void FrameBudget::frame_done(double seconds, double fixedSeconds) {
+    bool hit = seconds <= budget;
+    hits += hit;
+    history.push_back(Frame{scale, lod, seconds, hit});
+
+    fixedCost = history.size() == 1 || fixedSeconds > fixedCost ? fixedSeconds
+                                                                : fixedCost + smoothing * (fixedSeconds - fixedCost);
+    double cost = std::max(seconds - fixedSeconds, 0.) / (double(scale) * scale);
+    if (costPerArea < 0 || cost > costPerArea)
+        costPerArea = cost;
+    else
+        costPerArea += smoothing * (cost - costPerArea);
+
+    // what is left of the budget for the area dependent part
+    const double target = headroom * budget - fixedCost;
+    float next = target > 0 ? static_cast<float>(std::sqrt(target / std::max(costPerArea, 1e-9))) : 0.f;
+    next = std::max(minScale, std::min(1.f, std::floor(next / scaleStep) * scaleStep));
+
+    // out of resolution to give: a coarser model; plenty of room at full resolution: a finer one
+    if (next <= minScale && costPerArea * minScale * minScale > target && lod < maxLod) {
+        lod++;
+        costPerArea = -1;
+        return;
+    }
+    if (next >= 1 && lod > 0 && costPerArea < target / 2) {
+        lod--;
+        costPerArea = -1;
+        return;
+    }
+    if (!hit || std::abs(next - scale) >= minChange || next == 1 || next == minScale)
+        scale = next;
+}
+
+double FrameBudget::get_budget() const {
+    return budget;
+}
+
+int FrameBudget::get_hits() const {
+    return hits;
+}
+
+int FrameBudget::get_misses() const {
+    return static_cast<int>(history.size()) - hits;
+}
+
+const std::vector<FrameBudget::Frame> &FrameBudget::get_history() const {
+    return history;
+}
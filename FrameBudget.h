@@ -0,0 +1,57 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_FRAMEBUDGET_H
+#define SIMPLESOFTWARERENDERER_FRAMEBUDGET_H
+
+#include <vector>
+
+// Dynamic resolution for a fixed frame time budget. A frame costs a fixed part (such as scaling up to the output) plus
+// a part that grows with the rendered area; running estimates of both, the latter in seconds per unit of area (the
+// output being 1), give the scale of the next frame so it lands at a safety margin below the budget. A miss takes
+// effect at once, getting faster is smoothed. Scales move in steps of 1/32 and small changes are ignored, so the
+// internal resolution does not jitter. When the smallest scale is still too slow the model switches to a coarser LOD,
+// back when the full scale fits easily.
+class FrameBudget {
+public:
+    struct Frame {
+        float scale;
+        int lod;
+        double seconds;
+        bool hit;
+    };
+
+    FrameBudget(double budgetSeconds, float minScale = .25f, int maxLod = 0);
+
+    // linear factor of the output resolution to render the next frame at
+    float get_scale() const;
+
+    // LOD level of the next frame, 0 is the full model
+    int get_lod() const;
+
+    // the frame drawn at get_scale() and get_lod() took seconds, fixedSeconds of them independent of the scale;
+    // picks the next scale and LOD
+    void frame_done(double seconds, double fixedSeconds = 0);
+
+    double get_budget() const;
+
+    int get_hits() const;
+
+    int get_misses() const;
+
+    const std::vector<Frame> &get_history() const;
+
+private:
+    double budget;
+    float minScale;
+    int maxLod;
+    float scale;
+    int lod;
+    double costPerArea;     // < 0 until measured at the current LOD
+    double fixedCost;
+    int hits;
+    std::vector<Frame> history;
+};
+
+#endif //SIMPLESOFTWARERENDERER_FRAMEBUDGET_H
@@ -0,0 +1,215 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <csignal>
+#include <iostream>
+#include "FrameSink.h"
+#include "Trace.h"
+
+TGAFileSink::TGAFileSink(int32_t w, int32_t h, int frames, bool writeZBuffer, bool autoDepthRange)
+        : zBufImage(w, h, TGAImage::GRAYSCALE), frames(frames), writeZBuffer(writeZBuffer),
+          autoDepthRange(autoDepthRange) {}
+
+std::string TGAFileSink::frame_file(const char *name, int frame) const {
+    if (frames == 1)
+        return std::string(name) + ".tga";
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%04d.tga", frame);
+    return name + std::string(suffix);
+}
+
+bool TGAFileSink::write(Framebuffer &framebuffer, int frame) {
+    {
+        Trace::Span span("flip");
+        framebuffer.color.flip_vertically();
+    }
+    bool is_ok;
+    {
+        Trace::Span span("tga write");
+        is_ok = framebuffer.color.write_tga_file(frame_file("output", frame));
+    }
+
+    if (writeZBuffer) {
+        {
+            Trace::Span span("depth image");
+            framebuffer.depth_image(zBufImage, autoDepthRange);
+            zBufImage.flip_vertically();
+        }
+        Trace::Span span("tga write");
+        is_ok = zBufImage.write_tga_file(frame_file("zBuffer", frame)) && is_ok;
+    }
+    return is_ok;
+}
+
+StreamSink::StreamSink(const std::string &path, Format format, int32_t w, int32_t h, int fps) : out(nullptr),
+                                                                                               ownsStream(false),
+                                                                                               format(format),
+                                                                                               width(w), height(h),
+                                                                                               fps(fps), frame(),
+                                                                                               planes(),
+                                                                                               converted(false) {
+    // a consumer going away must end up as a write error, not kill the renderer
+    signal(SIGPIPE, SIG_IGN);
+
+    if (path == "-") {
+        out = stdout;
+    } else {
+        out = fopen(path.c_str(), "wb");
+        ownsStream = true;
+        if (!out) {
+            std::cerr << "Can't open stream " << path << "\n";
+            return;
+        }
+    }
+    setvbuf(out, nullptr, _IOFBF, size_t(1) << 20);
+
+    if (format == Y4M) {
+        planes.resize(static_cast<size_t>(width) * height * 3);
+        fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+    }
+}
+
+StreamSink::~StreamSink() {
+    if (!out)
+        return;
+    if (ownsStream)
+        fclose(out);
+    else
+        fflush(out);
+}
+
+bool StreamSink::is_open() const {
+    return out != nullptr;
+}
+
+bool StreamSink::write(Framebuffer &framebuffer, int) {
+    if (!out)
+        return false;
+
+    const TGAImage &image = framebuffer.color;
+    if (image.get_width() != width || image.get_height() != height) {
+        std::cerr << "Frame size does not match the stream\n";
+        return false;
+    }
+
+    bool is_ok;
+    if (format == PPM) {
+        fprintf(out, "P6\n%d %d\n255\n", width, height);
+        is_ok = write_rows(image, framebuffer.changedRows);
+    } else if (format == Y4M) {
+        is_ok = write_y4m(image, framebuffer.changedRows);
+    } else {
+        is_ok = write_rows(image, framebuffer.changedRows);
+    }
+
+    if (!is_ok || ferror(out)) {
+        std::cerr << "Can't write the frame to the stream\n";
+        return false;
+    }
+    return true;
+}
+
+bool StreamSink::write_rows(const TGAImage &image, const std::vector<uint8_t> &changedRows) {
+    const int bpp = image.get_bytesPerPixel();
+    const uint64_t bytes_per_line = static_cast<uint64_t>(width) * bpp;
+    const bool native = (format == BGR && bpp == TGAImage::RGB) || (format == BGRA && bpp == TGAImage::RGBA);
+
+    if (native) {
+        for (int32_t j = height - 1; j >= 0; --j) {
+            if (fwrite(image.buffer() + j * bytes_per_line, 1, bytes_per_line, out) != bytes_per_line)
+                return false;
+        }
+        return true;
+    }
+
+    const int outBpp = format == BGRA ? 4 : 3;
+    const size_t out_per_line = static_cast<size_t>(width) * outBpp;
+    frame.resize(out_per_line * height);
+    {
+        Trace::Span span("convert rows");
+        for (int32_t j = height - 1; j >= 0; --j) {
+            if (converted && !changedRows[j])
+                continue;
+            const uint8_t *src = image.buffer() + j * bytes_per_line;
+            uint8_t *dst = frame.data() + (height - 1 - j) * out_per_line;
+            for (int32_t i = 0; i < width; ++i, src += bpp) {
+                uint8_t b = src[0];
+                uint8_t g = bpp == TGAImage::GRAYSCALE ? src[0] : src[1];
+                uint8_t r = bpp == TGAImage::GRAYSCALE ? src[0] : src[2];
+                if (format == BGR || format == BGRA) {
+                    *dst++ = b;
+                    *dst++ = g;
+                    *dst++ = r;
+                    if (format == BGRA)
+                        *dst++ = bpp == TGAImage::RGBA ? src[3] : 255;
+                } else {
+                    *dst++ = r;
+                    *dst++ = g;
+                    *dst++ = b;
+                }
+            }
+        }
+    }
+    converted = true;
+    return fwrite(frame.data(), 1, frame.size(), out) == frame.size();
+}
+
+bool StreamSink::write_y4m(const TGAImage &image, const std::vector<uint8_t> &changedRows) {
+    const int bpp = image.get_bytesPerPixel();
+    const uint64_t bytes_per_line = static_cast<uint64_t>(width) * bpp;
+    const size_t planeSize = static_cast<size_t>(width) * height;
+
+    {
+        // BT.601 studio swing, integer approximation
+        Trace::Span span("convert rows");
+        for (int32_t j = 0; j < height; ++j) {
+            if (converted && !changedRows[height - 1 - j])
+                continue;
+            const uint8_t *src = image.buffer() + (height - 1 - j) * bytes_per_line;
+            uint8_t *Y = planes.data() + static_cast<size_t>(j) * width;
+            uint8_t *U = Y + planeSize;
+            uint8_t *V = U + planeSize;
+            for (int32_t i = 0; i < width; ++i, src += bpp) {
+                int b = src[0];
+                int g = bpp == TGAImage::GRAYSCALE ? src[0] : src[1];
+                int r = bpp == TGAImage::GRAYSCALE ? src[0] : src[2];
+                *Y++ = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                *U++ = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                *V++ = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+    }
+    converted = true;
+
+    fputs("FRAME\n", out);
+    return fwrite(planes.data(), 1, planes.size(), out) == planes.size();
+}
+
+std::unique_ptr<FrameSink> make_sink(const std::string &kind, const std::string &path, int32_t w, int32_t h,
+                                     int frames, bool autoDepthRange) {
+    if (kind == "tga")
+        return std::unique_ptr<FrameSink>(new TGAFileSink(w, h, frames, true, autoDepthRange));
+
+    StreamSink::Format format;
+    if (kind == "bgr") {
+        format = StreamSink::BGR;
+    } else if (kind == "rgb") {
+        format = StreamSink::RGB;
+    } else if (kind == "bgra") {
+        format = StreamSink::BGRA;
+    } else if (kind == "ppm") {
+        format = StreamSink::PPM;
+    } else if (kind == "y4m") {
+        format = StreamSink::Y4M;
+    } else {
+        std::cerr << "Unknown sink " << kind << "\n";
+        return nullptr;
+    }
+
+    StreamSink *stream = new StreamSink(path, format, w, h);
+    std::unique_ptr<FrameSink> sink(stream);
+    if (!stream->is_open())
+        return nullptr;
+    return sink;
+}
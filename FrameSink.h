@@ -0,0 +1,78 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_FRAMESINK_H
+#define SIMPLESOFTWARERENDERER_FRAMESINK_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Framebuffer.h"
+
+// Destination of the rendered frames. Framebuffers come in as rendered (bottom-up rows);
+// a sink may scribble over the framebuffer, it is cleared right after write() returns.
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    virtual bool write(Framebuffer &framebuffer, int frame) = 0;
+};
+
+// output.tga + zBuffer.tga, numbered when there is more than one frame; with autoDepthRange the
+// z-buffer image spans the depth range of each frame instead of the raw z
+class TGAFileSink : public FrameSink {
+public:
+    TGAFileSink(int32_t w, int32_t h, int frames, bool writeZBuffer = true, bool autoDepthRange = false);
+
+    bool write(Framebuffer &framebuffer, int frame) override;
+
+private:
+    TGAImage zBufImage;
+    int frames;
+    bool writeZBuffer;
+    bool autoDepthRange;
+
+    std::string frame_file(const char *name, int frame) const;
+};
+
+// Headerless frames, PPM (P6) or YUV4MPEG2 stream written straight from the framebuffer to stdout
+// ("-") or any file or named pipe, e.g. for piping into ffmpeg. Rows are emitted top-down by walking
+// the framebuffer backwards, so there is no flip pass; the only copies are the per-row swizzles
+// the pixel format demands. Swizzled and YUV frames are kept, and the next frame converts only the rows its
+// framebuffer marks as changed.
+class StreamSink : public FrameSink {
+public:
+    enum Format {
+        BGR, RGB, BGRA, PPM, Y4M
+    };
+
+    StreamSink(const std::string &path, Format format, int32_t w, int32_t h, int fps = 25);
+
+    ~StreamSink() override;
+
+    bool is_open() const;
+
+    bool write(Framebuffer &framebuffer, int frame) override;
+
+private:
+    FILE *out;
+    bool ownsStream;
+    Format format;
+    int32_t width, height;
+    int fps;
+    std::vector<uint8_t> frame;     // the last frame in the output format, top-down
+    std::vector<uint8_t> planes;
+    bool converted;                 // frame or planes hold the last frame
+
+    bool write_rows(const TGAImage &image, const std::vector<uint8_t> &changedRows);
+
+    bool write_y4m(const TGAImage &image, const std::vector<uint8_t> &changedRows);
+};
+
+// "tga", or "bgr", "rgb", "bgra", "ppm", "y4m" streamed to path; nullptr for unknown kinds
+std::unique_ptr<FrameSink> make_sink(const std::string &kind, const std::string &path, int32_t w, int32_t h,
+                                     int frames, bool autoDepthRange = false);
+
+#endif //SIMPLESOFTWARERENDERER_FRAMESINK_H
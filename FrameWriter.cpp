@@ -0,0 +1,112 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <chrono>
+#include "AllocStats.h"
+#include "FrameWriter.h"
+#include "Trace.h"
+
+FrameWriter::FrameWriter(int32_t w, int32_t h, std::unique_ptr<FrameSink> sink, int nBuffers,
+                         Framebuffer::Layout layout)
+        : sink(std::move(sink)), buffers(), freeBuffers(), queue(static_cast<size_t>(nBuffers)), queueHead(0),
+          queueSize(0), mutex(), changed(), written(0), failed(0), stallSeconds(0), stopping(false), writer() {
+    for (int i = 0; i < nBuffers; ++i) {
+        buffers.emplace_back(new Framebuffer(w, h, TGAImage::RGB, layout));
+        freeBuffers.push_back(buffers.back().get());
+    }
+    writer = std::thread(&FrameWriter::writer_loop, this);
+}
+
+FrameWriter::~FrameWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+Framebuffer *FrameWriter::acquire() {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !freeBuffers.empty(); });
+    stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Framebuffer *framebuffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return framebuffer;
+}
+
+void FrameWriter::submit(Framebuffer *framebuffer, int frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue[(queueHead + queueSize++) % queue.size()] = {framebuffer, frame};
+    }
+    changed.notify_all();
+}
+
+void FrameWriter::release(Framebuffer *framebuffer) {
+    framebuffer->clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(framebuffer);
+    }
+    changed.notify_all();
+}
+
+void FrameWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return freeBuffers.size() == buffers.size(); });
+}
+
+int FrameWriter::get_written() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+double FrameWriter::get_stall_seconds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stallSeconds;
+}
+
+int FrameWriter::get_failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+void FrameWriter::writer_loop() {
+    AllocStats::Scope stage(AllocStats::OUTPUT);
+    Trace::set_thread_name("frame writer");
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return stopping || queueSize; });
+            if (!queueSize)
+                return;
+            job = queue[queueHead];
+            queueHead = (queueHead + 1) % queue.size();
+            queueSize--;
+        }
+
+        bool is_ok;
+        {
+            {
+                Trace::Span span("detile");
+                job.framebuffer->resolve();
+            }
+            Trace::Span span("write frame", job.frame);
+            is_ok = sink->write(*job.framebuffer, job.frame);
+        }
+        job.framebuffer->clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeBuffers.push_back(job.framebuffer);
+            (is_ok ? written : failed)++;
+        }
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,71 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_FRAMEWRITER_H
+#define SIMPLESOFTWARERENDERER_FRAMEWRITER_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameSink.h"
+#include "Framebuffer.h"
+
+// Writes rendered frames on a background thread.
+// The writer owns a fixed ring of framebuffers: the renderer acquire()s a free one, draws into it
+// and submit()s it, the writer thread passes it to the sink and hands the buffer back cleared.
+// When all buffers are waiting for the disk acquire() blocks, which throttles the renderer.
+class FrameWriter {
+public:
+    FrameWriter(int32_t w, int32_t h, std::unique_ptr<FrameSink> sink, int nBuffers = 2,
+                Framebuffer::Layout layout = Framebuffer::LINEAR);
+
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter &) = delete;
+
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    Framebuffer *acquire();
+
+    void submit(Framebuffer *framebuffer, int frame);
+
+    // hands an acquired framebuffer back without writing it, e.g. when rendering the frame failed
+    void release(Framebuffer *framebuffer);
+
+    // blocks until every submitted frame is written
+    void flush();
+
+    int get_written() const;
+
+    // total time the renderer spent in acquire() waiting for the writer
+    double get_stall_seconds() const;
+
+    int get_failed() const;
+
+private:
+    struct Job {
+        Framebuffer *framebuffer;
+        int frame;
+    };
+
+    std::unique_ptr<FrameSink> sink;
+    std::vector<std::unique_ptr<Framebuffer>> buffers;
+    std::vector<Framebuffer *> freeBuffers;
+    std::vector<Job> queue;   // ring of at most buffers.size() jobs
+    size_t queueHead;
+    size_t queueSize;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    int written;
+    int failed;
+    double stallSeconds;
+    bool stopping;
+    std::thread writer;
+
+    void writer_loop();
+};
+
+#endif //SIMPLESOFTWARERENDERER_FRAMEWRITER_H
@@ -0,0 +1,159 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include "Framebuffer.h"
+#include "ImageOps.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+static const int tileSize = 64;
+static const int blockSize = 8;
+static const int rowGrain = 16;
+
+Framebuffer::Framebuffer(int32_t w, int32_t h, uint8_t bpp, Layout layout) : color(w, h, bpp), zBuffer(),
+                                                                             changedRows(static_cast<size_t>(h), 1),
+                                                                             layout(layout), width(w),
+                                                                             tilesX((w + tileSize - 1) / tileSize),
+                                                                             tiles() {
+    size_t nPixels = static_cast<size_t>(w) * h;
+    if (layout == TILED) {
+        nPixels = static_cast<size_t>(tilesX) * ((h + tileSize - 1) / tileSize) * tileSize * tileSize;
+        tiles.assign(nPixels * bpp, 0);
+    }
+    zBuffer.assign(nPixels, std::numeric_limits<int>::min());
+}
+
+int32_t Framebuffer::get_width() const {
+    return color.get_width();
+}
+
+int32_t Framebuffer::get_height() const {
+    return color.get_height();
+}
+
+Framebuffer::Layout Framebuffer::get_layout() const {
+    return layout;
+}
+
+uint8_t *Framebuffer::pixels() {
+    return layout == TILED ? tiles.data() : color.buffer();
+}
+
+const uint8_t *Framebuffer::pixels() const {
+    return layout == TILED ? tiles.data() : color.buffer();
+}
+
+size_t Framebuffer::pixel_count() const {
+    return zBuffer.size();
+}
+
+void Framebuffer::clear() {
+    clear_color();
+    std::fill(zBuffer.begin(), zBuffer.end(), std::numeric_limits<int>::min());
+}
+
+void Framebuffer::clear_color() {
+    std::fill(changedRows.begin(), changedRows.end(), 1);
+    if (layout == TILED)
+        std::fill(tiles.begin(), tiles.end(), 0);
+    else
+        color.clear();
+}
+
+void Framebuffer::resolve() {
+    if (layout != TILED)
+        return;
+    const int32_t height = get_height();
+    const int bpp = color.get_bytesPerPixel();
+    uint8_t *dst = color.buffer();
+    // every block row is 8 contiguous pixels in the tiles
+    ThreadPool::instance().parallel_for(0, height, rowGrain, [&](int first, int last) {
+        for (int32_t y = first; y < last; ++y) {
+            uint8_t *row = dst + static_cast<size_t>(y) * width * bpp;
+            for (int32_t x = 0; x < width; x += blockSize) {
+                size_t n = static_cast<size_t>(std::min(blockSize, width - x)) * bpp;
+                memcpy(row + static_cast<size_t>(x) * bpp, tiles.data() + pixel_index(x, y) * bpp, n);
+            }
+        }
+    });
+}
+
+void Framebuffer::upscale_from(const Framebuffer &source) {
+    if (layout == TILED) {
+        std::cerr << "Can't upscale into a tiled framebuffer\n";
+        return;
+    }
+    Trace::Span span("upscale");
+    const int32_t w = get_width(), h = get_height();
+    const int32_t sourceWidth = source.get_width(), sourceHeight = source.get_height();
+    if (sourceWidth == w && sourceHeight == h)
+        memcpy(color.buffer(), source.color.buffer(), static_cast<size_t>(w) * h * color.get_bytesPerPixel());
+    else
+        resize_bilinear(source.color, color);
+    std::vector<int32_t> column(static_cast<size_t>(w));
+    for (int32_t x = 0; x < w; ++x)
+        column[x] = static_cast<int32_t>(static_cast<int64_t>(x) * sourceWidth / w);
+    ThreadPool::instance().parallel_for(0, h, rowGrain, [&](int first, int last) {
+        for (int32_t y = first; y < last; ++y) {
+            int32_t sy = static_cast<int32_t>(static_cast<int64_t>(y) * sourceHeight / h);
+            for (int32_t x = 0; x < w; ++x)
+                zBuffer[pixel_index(x, y)] = source.zBuffer[source.pixel_index(column[x], sy)];
+        }
+    });
+}
+
+void Framebuffer::depth_image(TGAImage &image, bool autoRange) const {
+    const int32_t height = get_height();
+    const int empty = std::numeric_limits<int>::min();
+    ThreadPool &pool = ThreadPool::instance();
+    if (!image.buffer() || image.get_width() != width || image.get_height() != height ||
+        image.get_bytesPerPixel() != TGAImage::GRAYSCALE) {
+        std::cerr << "The depth image must be grayscale and of the framebuffer size\n";
+        return;
+    }
+
+    int zMin = std::numeric_limits<int>::max(), zMax = empty;
+    if (autoRange) {
+        std::mutex mutex;
+        pool.parallel_for(0, height, rowGrain, [&](int first, int last) {
+            int lo = std::numeric_limits<int>::max(), hi = empty;
+            for (int32_t y = first; y < last; ++y) {
+                for (int32_t x = 0; x < width; ++x) {
+                    int z = zBuffer[pixel_index(x, y)];
+                    if (z != empty) {
+                        lo = std::min(lo, z);
+                        hi = std::max(hi, z);
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            zMin = std::min(zMin, lo);
+            zMax = std::max(zMax, hi);
+        });
+    }
+    // z * scale + bias in 16.16 fixed point, the plain mapping is the identity truncated to 8 bit
+    int64_t scale = 1 << 16, bias = 0;
+    if (autoRange && zMax != empty) {
+        scale = zMax > zMin ? (int64_t(254) << 16) / (int64_t(zMax) - zMin) : 0;
+        bias = (int64_t(255) << 16) - scale * zMax;
+    }
+
+    pool.parallel_for(0, height, rowGrain, [&](int first, int last) {
+        for (int32_t y = first; y < last; ++y) {
+            uint8_t *out = image.buffer() + static_cast<size_t>(y) * width;
+            for (int32_t x = 0; x < width; ++x) {
+                int z = zBuffer[pixel_index(x, y)];
+                if (autoRange)
+                    out[x] = z == empty ? 0 : static_cast<uint8_t>((z * scale + bias) >> 16);
+                else
+                    out[x] = static_cast<uint8_t>(z);
+            }
+        }
+    });
+}
@@ -0,0 +1,72 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_FRAMEBUFFER_H
+#define SIMPLESOFTWARERENDERER_FRAMEBUFFER_H
+
+#include <vector>
+#include "Arena.h"
+#include "TGAImage.h"
+
+// Render target of one frame: the color image and its z-buffer.
+// In the TILED layout color and depth are stored in 64x64 tiles of 8x8 blocks, so the pixels a triangle touches
+// share cache lines and pages; resolve() then detiles the color into the linear image the sinks write.
+// Renderers address both buffers through pixels() and pixel_index(), the z-buffer is in the same order.
+struct Framebuffer {
+    enum Layout {
+        LINEAR, TILED
+    };
+
+    TGAImage color;     // linear image, current after resolve()
+    std::vector<int, CacheAlignedAllocator<int>> zBuffer;
+    // 1 for the rows that differ from the frame written before this one; all of them unless the renderer knows
+    // better, clear() marks every row again. Sinks may re-encode just these rows.
+    std::vector<uint8_t> changedRows;
+
+    Framebuffer(int32_t w, int32_t h, uint8_t bpp = TGAImage::RGB, Layout layout = LINEAR);
+
+    int32_t get_width() const;
+
+    int32_t get_height() const;
+
+    Layout get_layout() const;
+
+    // color storage in the render layout, get_bytesPerPixel() bytes at every pixel_index()
+    uint8_t *pixels();
+
+    const uint8_t *pixels() const;
+
+    // pixels in the render layout, tiled storage is padded to whole tiles
+    size_t pixel_count() const;
+
+    size_t pixel_index(int x, int y) const {
+        if (layout == LINEAR)
+            return static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+        size_t tile = static_cast<size_t>(y >> 6) * tilesX + (x >> 6);
+        return tile << 12 | (y & 56) << 6 | (x & 56) << 3 | (y & 7) << 3 | (x & 7);
+    }
+
+    void clear();
+
+    // clears the color only, the depth stays; every row is marked changed
+    void clear_color();
+
+    // copies the tiled color into color, nothing to do in the linear layout
+    void resolve();
+
+    // source stretched over this framebuffer, which must be in the linear layout: bilinear color, nearest depth
+    void upscale_from(const Framebuffer &source);
+
+    // the z-buffer as a grayscale image of the same size: z truncated to 8 bit, or with autoRange the range of
+    // the drawn depths stretched over 1..255 (empty pixels stay 0)
+    void depth_image(TGAImage &image, bool autoRange = false) const;
+
+private:
+    Layout layout;
+    int32_t width;
+    int32_t tilesX;
+    std::vector<uint8_t, CacheAlignedAllocator<uint8_t>> tiles;
+};
+
+#endif //SIMPLESOFTWARERENDERER_FRAMEBUFFER_H
@@ -0,0 +1,241 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "ImageOps.h"
+
+// rows per chunk: big enough to amortize the scheduling, small enough to balance 4K images over many threads
+static const int rowGrain = 16;
+
+static uint8_t *row(TGAImage &image, int y) {
+    return image.buffer() + static_cast<size_t>(y) * image.get_width() * image.get_bytesPerPixel();
+}
+
+static const uint8_t *row(const TGAImage &image, int y) {
+    return image.buffer() + static_cast<size_t>(y) * image.get_width() * image.get_bytesPerPixel();
+}
+
+void flip_vertically(TGAImage &image, ThreadPool &pool) {
+    if (!image.buffer())
+        return;
+    const int height = image.get_height();
+    const size_t bytes = static_cast<size_t>(image.get_width()) * image.get_bytesPerPixel();
+    pool.parallel_for(0, height / 2, rowGrain, [&](int first, int last) {
+        for (int j = first; j < last; ++j)
+            std::swap_ranges(row(image, j), row(image, j) + bytes, row(image, height - 1 - j));
+    });
+}
+
+template<int bpp>
+static void reverse_pixels(uint8_t *p, int width) {
+    uint8_t *q = p + (width - 1) * bpp;
+    for (; p < q; p += bpp, q -= bpp) {
+        for (int c = 0; c < bpp; ++c)
+            std::swap(p[c], q[c]);
+    }
+}
+
+static void reverse_row(uint8_t *p, int width, int bpp) {
+    if (bpp == TGAImage::GRAYSCALE) {
+        std::reverse(p, p + width);
+    } else if (bpp == TGAImage::RGBA) {
+        reverse_pixels<TGAImage::RGBA>(p, width);
+    } else {
+        reverse_pixels<TGAImage::RGB>(p, width);
+    }
+}
+
+void flip_horizontally(TGAImage &image, ThreadPool &pool) {
+    if (!image.buffer())
+        return;
+    const int width = image.get_width();
+    const int bpp = image.get_bytesPerPixel();
+    pool.parallel_for(0, image.get_height(), rowGrain, [&](int first, int last) {
+        for (int j = first; j < last; ++j)
+            reverse_row(row(image, j), width, bpp);
+    });
+}
+
+// destination coordinate d takes count source samples starting at first, weights in 1.14 fixed point summing to 1
+struct Taps {
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<int> offset;     // into weights
+    std::vector<int> weights;
+};
+
+static void add_taps(Taps &taps, int first, std::vector<double> &w) {
+    const int one = 1 << 14;
+    double sum = 0;
+    for (double v : w)
+        sum += v;
+    int total = 0, largest = 0;
+    taps.first.push_back(first);
+    taps.count.push_back(static_cast<int>(w.size()));
+    taps.offset.push_back(static_cast<int>(taps.weights.size()));
+    for (size_t k = 0; k < w.size(); ++k) {
+        int q = static_cast<int>(std::lround(w[k] / sum * one));
+        taps.weights.push_back(q);
+        total += q;
+        if (q > taps.weights[taps.offset.back() + largest])
+            largest = static_cast<int>(k);
+    }
+    // rounding leftovers go to the heaviest tap so flat areas stay exactly flat
+    taps.weights[taps.offset.back() + largest] += one - total;
+}
+
+static Taps area_taps(int srcSize, int dstSize) {
+    Taps taps;
+    const double scale = double(srcSize) / dstSize;
+    std::vector<double> w;
+    for (int d = 0; d < dstSize; ++d) {
+        double lo = d * scale, hi = (d + 1) * scale;
+        int first = static_cast<int>(lo);
+        int last = std::min(srcSize, static_cast<int>(std::ceil(hi)));
+        w.clear();
+        for (int s = first; s < last; ++s)
+            w.push_back(std::min(hi, s + 1.) - std::max(lo, double(s)));
+        add_taps(taps, first, w);
+    }
+    return taps;
+}
+
+static Taps bilinear_taps(int srcSize, int dstSize) {
+    Taps taps;
+    const double scale = double(srcSize) / dstSize;
+    std::vector<double> w;
+    for (int d = 0; d < dstSize; ++d) {
+        // sample centers line up: destination pixel center (d + 0.5) maps onto the source grid
+        double c = std::max(0., std::min(srcSize - 1., (d + .5) * scale - .5));
+        int s0 = std::min(static_cast<int>(c), srcSize - 1);
+        double f = c - s0;
+        w.clear();
+        w.push_back(1 - f);
+        if (s0 + 1 < srcSize)
+            w.push_back(f);
+        add_taps(taps, s0, w);
+    }
+    return taps;
+}
+
+template<int bpp>
+static void resample_row(const uint8_t *in, uint16_t *out, const Taps &taps, int dstWidth) {
+    for (int x = 0; x < dstWidth; ++x, out += bpp) {
+        const int *w = taps.weights.data() + taps.offset[x];
+        const uint8_t *p = in + static_cast<size_t>(taps.first[x]) * bpp;
+        int sum[bpp] = {};
+        for (int k = 0; k < taps.count[x]; ++k, p += bpp) {
+            for (int c = 0; c < bpp; ++c)
+                sum[c] += p[c] * w[k];
+        }
+        for (int c = 0; c < bpp; ++c)
+            out[c] = static_cast<uint16_t>((sum[c] + (1 << 5)) >> 6);
+    }
+}
+
+// separable resampling: rows into 8.8 fixed point, then columns back to 8 bit
+static bool resample(const TGAImage &src, TGAImage &dst, const Taps &xTaps, const Taps &yTaps, ThreadPool &pool) {
+    const int bpp = src.get_bytesPerPixel();
+    if (!src.buffer() || !dst.buffer() || dst.get_bytesPerPixel() != bpp) {
+        std::cerr << "Can't resize between different formats\n";
+        return false;
+    }
+    const int srcHeight = src.get_height();
+    const int dstWidth = dst.get_width(), dstHeight = dst.get_height();
+    const size_t rowValues = static_cast<size_t>(dstWidth) * bpp;
+    std::vector<uint16_t> horizontal(rowValues * srcHeight);
+
+    pool.parallel_for(0, srcHeight, rowGrain, [&](int first, int last) {
+        for (int j = first; j < last; ++j) {
+            uint16_t *out = horizontal.data() + rowValues * j;
+            if (bpp == TGAImage::GRAYSCALE)
+                resample_row<TGAImage::GRAYSCALE>(row(src, j), out, xTaps, dstWidth);
+            else if (bpp == TGAImage::RGBA)
+                resample_row<TGAImage::RGBA>(row(src, j), out, xTaps, dstWidth);
+            else
+                resample_row<TGAImage::RGB>(row(src, j), out, xTaps, dstWidth);
+        }
+    });
+
+    pool.parallel_for(0, dstHeight, rowGrain, [&](int first, int last) {
+        std::vector<int> sum;
+        for (int y = first; y < last; ++y) {
+            const int *w = yTaps.weights.data() + yTaps.offset[y];
+            const uint16_t *in = horizontal.data() + rowValues * yTaps.first[y];
+            uint8_t *out = row(dst, y);
+            // the bilinear case in one go, without the accumulator row
+            if (yTaps.count[y] == 2) {
+                const uint16_t *next = in + rowValues;
+                const int w0 = w[0], w1 = w[1];
+                for (size_t i = 0; i < rowValues; ++i)
+                    out[i] = static_cast<uint8_t>(std::min(255, (in[i] * w0 + next[i] * w1 + (1 << 21)) >> 22));
+                continue;
+            }
+            // whole rows at a time: one multiply-add per value, contiguous in memory
+            sum.assign(rowValues, 0);
+            for (int k = 0; k < yTaps.count[y]; ++k, in += rowValues) {
+                const int weight = w[k];
+                for (size_t i = 0; i < rowValues; ++i)
+                    sum[i] += in[i] * weight;
+            }
+            for (size_t i = 0; i < rowValues; ++i)
+                out[i] = static_cast<uint8_t>(std::min(255, (sum[i] + (1 << 21)) >> 22));
+        }
+    });
+    return true;
+}
+
+bool resize_area(const TGAImage &src, TGAImage &dst, ThreadPool &pool) {
+    return resample(src, dst, area_taps(src.get_width(), dst.get_width()),
+                    area_taps(src.get_height(), dst.get_height()), pool);
+}
+
+bool resize_bilinear(const TGAImage &src, TGAImage &dst, ThreadPool &pool) {
+    return resample(src, dst, bilinear_taps(src.get_width(), dst.get_width()),
+                    bilinear_taps(src.get_height(), dst.get_height()), pool);
+}
+
+static void convert_row(const uint8_t *in, int srcBpp, uint8_t *out, int dstBpp, int width) {
+    if (srcBpp == dstBpp) {
+        memcpy(out, in, static_cast<size_t>(width) * srcBpp);
+    } else if (srcBpp == TGAImage::GRAYSCALE) {
+        for (int i = 0; i < width; ++i) {
+            out[i * dstBpp] = out[i * dstBpp + 1] = out[i * dstBpp + 2] = in[i];
+            if (dstBpp == TGAImage::RGBA)
+                out[i * dstBpp + 3] = 255;
+        }
+    } else if (dstBpp == TGAImage::GRAYSCALE) {
+        // BGR order, integer BT.601 weights
+        for (int i = 0; i < width; ++i) {
+            const uint8_t *p = in + i * srcBpp;
+            out[i] = static_cast<uint8_t>((29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8);
+        }
+    } else {
+        for (int i = 0; i < width; ++i) {
+            out[i * dstBpp] = in[i * srcBpp];
+            out[i * dstBpp + 1] = in[i * srcBpp + 1];
+            out[i * dstBpp + 2] = in[i * srcBpp + 2];
+            if (dstBpp == TGAImage::RGBA)
+                out[i * dstBpp + 3] = 255;
+        }
+    }
+}
+
+bool convert_format(const TGAImage &src, TGAImage &dst, ThreadPool &pool) {
+    if (!src.buffer() || !dst.buffer() || src.get_width() != dst.get_width() ||
+        src.get_height() != dst.get_height()) {
+        std::cerr << "Can't convert between images of different sizes\n";
+        return false;
+    }
+    const int width = src.get_width();
+    pool.parallel_for(0, src.get_height(), rowGrain, [&](int first, int last) {
+        for (int j = first; j < last; ++j)
+            convert_row(row(src, j), src.get_bytesPerPixel(), row(dst, j), dst.get_bytesPerPixel(), width);
+    });
+    return true;
+}
@@ -0,0 +1,27 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_IMAGEOPS_H
+#define SIMPLESOFTWARERENDERER_IMAGEOPS_H
+
+#include "TGAImage.h"
+#include "ThreadPool.h"
+
+// Image post-processing kernels. Rows are spread over the pool, within a row the loops run over
+// contiguous bytes without per-pixel calls so the compiler can vectorize them.
+
+void flip_vertically(TGAImage &image, ThreadPool &pool = ThreadPool::instance());
+
+void flip_horizontally(TGAImage &image, ThreadPool &pool = ThreadPool::instance());
+
+// resample src into dst (its size, same format): area averaging weighs every source pixel by how much of the
+// destination pixel it covers and is meant for shrinking, bilinear for growing
+bool resize_area(const TGAImage &src, TGAImage &dst, ThreadPool &pool = ThreadPool::instance());
+
+bool resize_bilinear(const TGAImage &src, TGAImage &dst, ThreadPool &pool = ThreadPool::instance());
+
+// src converted into the format of dst (grayscale, RGB or RGBA), same size; gray is BT.601 luma, alpha 255
+bool convert_format(const TGAImage &src, TGAImage &dst, ThreadPool &pool = ThreadPool::instance());
+
+#endif //SIMPLESOFTWARERENDERER_IMAGEOPS_H
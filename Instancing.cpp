@@ -0,0 +1,318 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include "Instancing.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+void bounding_sphere(const std::vector<Vec3f> &vertices, Vec3f &center, float &radius) {
+    center = Vec3f(0, 0, 0);
+    radius = 0;
+    if (vertices.empty())
+        return;
+    Vec3f lo = vertices[0], hi = vertices[0];
+    for (Vec3f v : vertices) {
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = std::min(lo[k], v[k]);
+            hi[k] = std::max(hi[k], v[k]);
+        }
+    }
+    center = (lo + hi) * .5f;
+    for (const Vec3f &v : vertices)
+        radius = std::max(radius, (v - center).norm());
+}
+
+void instance_matrix(const float camera[4][4], const Instance &instance, float m[4][4]) {
+    // the last row of the instance matrix being 0 0 0 1
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            float sum = c == 3 ? camera[r][3] : 0.f;
+            for (int k = 0; k < 3; ++k)
+                sum += camera[r][k] * instance.transform[k][c];
+            m[r][c] = sum;
+        }
+    }
+}
+
+bool sphere_in_view(const float m[4][4], const Vec3f &center, float radius, int width, int height) {
+    // The screen x of a point p is X / W with X = m[0] . (p, 1) and W = m[3] . (p, 1), so 0 <= x <= width is
+    // X >= 0 and width * W - X >= 0: planes in model space, whatever the projection. A sphere is outside a plane
+    // when even its nearest point is, a . (center, 1) + radius * |a.xyz| < 0.
+    float planes[5][4];
+    for (int k = 0; k < 4; ++k) {
+        planes[0][k] = m[0][k];
+        planes[1][k] = width * m[3][k] - m[0][k];
+        planes[2][k] = m[1][k];
+        planes[3][k] = height * m[3][k] - m[1][k];
+        planes[4][k] = m[3][k];
+    }
+    // W is 1 on the plane through the look-at center and 0 at the camera
+    const float nearW = .1f;
+    planes[4][3] -= nearW;
+    for (int i = 0; i < 5; ++i) {
+        const float *a = planes[i];
+        float distance = a[0] * center.x + a[1] * center.y + a[2] * center.z + a[3];
+        float reach = radius * std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        if (distance + reach < 0)
+            return false;
+        if (i == 4 && distance - reach < 0)
+            return false;
+    }
+    return true;
+}
+
+void tint_factors(const Vec3f &tint, uint16_t factors[4]) {
+    const float bgr[3] = {tint.z, tint.y, tint.x};
+    for (int k = 0; k < 3; ++k)
+        factors[k] = static_cast<uint16_t>(std::lround(std::min(1.f, std::max(0.f, bgr[k])) * 256));
+    factors[3] = 256;
+}
+
+Instance make_instance(const Vec3f &position, float yaw, float scale, const Vec3f &tint) {
+    const float angle = yaw * float(M_PI) / 180;
+    const float c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+    Instance instance = {{{c, 0, s, position.x}, {0, scale, 0, position.y}, {-s, 0, c, position.z}}, tint};
+    return instance;
+}
+
+void instance_grid(const Model &model, int n, float extent, std::vector<Instance> &instances, unsigned seed) {
+    instances.clear();
+    if (n <= 0)
+        return;
+    std::vector<Vec3f> vertices(static_cast<size_t>(model.nVertices()));
+    model.decode_vertices(vertices.data());
+    Vec3f center;
+    float radius;
+    bounding_sphere(vertices, center, radius);
+
+    const int columns = static_cast<int>(std::ceil(std::sqrt(double(n))));
+    const int rows = (n + columns - 1) / columns;
+    const float cell = 2 * extent / columns;
+    const float scale = radius > 0 ? .45f * cell / radius : 1.f;
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    instances.reserve(static_cast<size_t>(n));
+    for (int i = 0; i < n; ++i) {
+        Vec3f position(-extent + cell * (i % columns + .5f), cell * ((rows - 1) * .5f - i / columns), 0);
+        Vec3f tint(.4f + .6f * unit(random), .4f + .6f * unit(random), .4f + .6f * unit(random));
+        Instance instance = make_instance(position, 80 * unit(random) - 40, scale, tint);
+        // the model center, not its origin, goes to the middle of the cell
+        for (int r = 0; r < 3; ++r)
+            instance.transform[r][3] -= instance.transform[r][0] * center.x + instance.transform[r][1] * center.y +
+                                        instance.transform[r][2] * center.z;
+        instances.push_back(instance);
+    }
+}
+
+InstancedRenderer::InstancedRenderer(Model *model, int batchTriangles)
+        : diffuse(model->get_diffuse_map()), nVertices(model->nVertices()),
+          nNormals(model->nNormals()), nFaces(model->nFaces()), vertices(), normals(), corners(), texels(),
+          sphereCenter(), sphereRadius(0), batchInstances(std::max(1, batchTriangles / std::max(1, nFaces))),
+          slots(), screen(), intensities(), bounds(), bins() {
+    vertices.resize(static_cast<size_t>(nVertices));
+    model->decode_vertices(vertices.data());
+    normals.resize(static_cast<size_t>(nNormals));
+    model->decode_normals(normals.data());
+    corners.resize(static_cast<size_t>(nFaces) * 3);
+    texels.resize(static_cast<size_t>(nFaces) * 3);
+    for (int iFace = 0; iFace < nFaces; ++iFace) {
+        for (int k = 0; k < 3; ++k) {
+            corners[iFace * 3 + k] = model->corner(iFace, k);
+            texels[iFace * 3 + k] = model->get_uv(iFace, k);
+        }
+    }
+    bounding_sphere(vertices, sphereCenter, sphereRadius);
+
+    slots.resize(static_cast<size_t>(batchInstances));
+    screen.resize(static_cast<size_t>(batchInstances) * nVertices);
+    intensities.resize(static_cast<size_t>(batchInstances) * nNormals);
+    bounds.resize(static_cast<size_t>(batchInstances) * nFaces);
+}
+
+size_t InstancedRenderer::scratch_bytes() const {
+    size_t binned = 0;
+    for (const std::vector<TriangleRef> &bin : bins)
+        binned += bin.capacity() * sizeof(TriangleRef);
+    return slots.capacity() * sizeof(Slot) + screen.capacity() * sizeof(Vec3i) +
+           intensities.capacity() * sizeof(float) + bounds.capacity() * sizeof(Bounds) + binned;
+}
+
+bool InstancedRenderer::setup(const Instance &instance, const float camera[4][4], const Vec3f &lightDirection,
+                              int width, int height, Slot &slot) const {
+    instance_matrix(camera, instance, slot.matrix);
+    if (!sphere_in_view(slot.matrix, sphereCenter, sphereRadius, width, height))
+        return false;
+
+    // normals stay in model space, the light goes the other way: n . (R^T l) = (R n) . l for the rotation R
+    const float (*t)[4] = instance.transform;
+    Vec3f light(t[0][0] * lightDirection.x + t[1][0] * lightDirection.y + t[2][0] * lightDirection.z,
+                t[0][1] * lightDirection.x + t[1][1] * lightDirection.y + t[2][1] * lightDirection.z,
+                t[0][2] * lightDirection.x + t[1][2] * lightDirection.y + t[2][2] * lightDirection.z);
+    float length = light.norm();
+    slot.light = length > 0 ? light * (lightDirection.norm() / length) : light;
+
+    tint_factors(instance.tint, slot.tint);
+    return true;
+}
+
+void InstancedRenderer::transform(int iSlot, int width, int height) {
+    const float (*m)[4] = slots[iSlot].matrix;
+    Vec3i *out = screen.data() + static_cast<size_t>(iSlot) * nVertices;
+    for (int i = 0; i < nVertices; ++i) {
+        const Vec3f &v = vertices[i];
+        float r[4];
+        for (int k = 0; k < 4; ++k)
+            r[k] = m[k][0] * v.x + m[k][1] * v.y + m[k][2] * v.z + m[k][3];
+        out[i] = Vec3f(r[0] / r[3], r[1] / r[3], r[2] / r[3]);
+    }
+
+    float *lit = intensities.data() + static_cast<size_t>(iSlot) * nNormals;
+    for (int i = 0; i < nNormals; ++i)
+        lit[i] = normals[i] * slots[iSlot].light;
+
+    Bounds *box = bounds.data() + static_cast<size_t>(iSlot) * nFaces;
+    for (int iFace = 0; iFace < nFaces; ++iFace) {
+        const Vec3i &s0 = out[corners[iFace * 3].x];
+        const Vec3i &s1 = out[corners[iFace * 3 + 1].x];
+        const Vec3i &s2 = out[corners[iFace * 3 + 2].x];
+        int xMin = std::max(0, std::min(s0.x, std::min(s1.x, s2.x)));
+        int xMax = std::min(width - 1, std::max(s0.x, std::max(s1.x, s2.x)));
+        int yMin = std::max(0, std::min(s0.y, std::min(s1.y, s2.y)));
+        int yMax = std::min(height - 1, std::max(s0.y, std::max(s1.y, s2.y)));
+        if (edge(s0, s1, s2.x, s2.y) == 0)
+            xMax = xMin - 1;
+        box[iFace] = Bounds{xMin, yMin, xMax, yMax};
+    }
+}
+
+long long InstancedRenderer::raster_row(int nSlots, int tileRow, Framebuffer &framebuffer) {
+    const int width = framebuffer.get_width();
+    const int height = framebuffer.get_height();
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int y0 = tileRow * tileSize, y1 = std::min(height, y0 + tileSize) - 1;
+    std::vector<TriangleRef> *rowBins = bins.data() + static_cast<size_t>(tileRow) * tilesX;
+
+    for (int tx = 0; tx < tilesX; ++tx)
+        rowBins[tx].clear();
+    for (int iSlot = 0; iSlot < nSlots; ++iSlot) {
+        const Bounds *box = bounds.data() + static_cast<size_t>(iSlot) * nFaces;
+        for (int iFace = 0; iFace < nFaces; ++iFace) {
+            const Bounds &b = box[iFace];
+            if (b.xMin > b.xMax || b.yMax < y0 || b.yMin > y1)
+                continue;
+            for (int tx = b.xMin / tileSize; tx <= b.xMax / tileSize; ++tx)
+                rowBins[tx].push_back(TriangleRef{iSlot, iFace});
+        }
+    }
+
+    const int bpp = framebuffer.color.get_bytesPerPixel();
+    uint8_t *data = framebuffer.pixels();
+    int *zBuffer = framebuffer.zBuffer.data();
+    FragmentBatch batch;
+    batch.n = 0;
+    long long fragments = 0;
+    for (int tx = 0; tx < tilesX; ++tx) {
+        const int x0 = tx * tileSize, x1 = std::min(width, x0 + tileSize) - 1;
+        for (const TriangleRef &ref : rowBins[tx]) {
+            const Slot &slot = slots[ref.slot];
+            const Vec3i *s = screen.data() + static_cast<size_t>(ref.slot) * nVertices;
+            const float *lit = intensities.data() + static_cast<size_t>(ref.slot) * nNormals;
+            Vec3i t[3];
+            Vec2i uv[3];
+            float ity[3];
+            for (int k = 0; k < 3; ++k) {
+                const Vec3i &corner = corners[ref.face * 3 + k];
+                t[k] = s[corner.x];
+                ity[k] = lit[corner.z];
+                uv[k] = texels[ref.face * 3 + k];
+            }
+            const Bounds &b = bounds[static_cast<size_t>(ref.slot) * nFaces + ref.face];
+            const int xMin = std::max(b.xMin, x0), xMax = std::min(b.xMax, x1);
+            const int yMin = std::max(b.yMin, y0), yMax = std::min(b.yMax, y1);
+            const float inverseArea = 1.f / edge(t[0], t[1], t[2].x, t[2].y);
+
+            for (int y = yMin; y <= yMax; ++y) {
+                // the edge() functions of barycentric() at the row start, stepped along x
+                int64_t e0 = edge(t[1], t[2], xMin, y), e1 = edge(t[2], t[0], xMin, y);
+                int64_t e2 = edge(t[0], t[1], xMin, y);
+                const int64_t d0 = int64_t(t[1].y) - t[2].y, d1 = int64_t(t[2].y) - t[0].y;
+                const int64_t d2 = int64_t(t[0].y) - t[1].y;
+                for (int x = xMin; x <= xMax; ++x, e0 += d0, e1 += d1, e2 += d2) {
+                    float b0 = e0 * inverseArea, b1 = e1 * inverseArea, b2 = e2 * inverseArea;
+                    if (b0 < 0 || b1 < 0 || b2 < 0)
+                        continue;
+                    fragments++;
+                    int z = static_cast<int>(b0 * t[0].z + b1 * t[1].z + b2 * t[2].z + .5f);
+                    size_t idx = framebuffer.pixel_index(x, y);
+                    if (zBuffer[idx] >= z)
+                        continue;
+                    zBuffer[idx] = z;
+
+                    batch.offsets[batch.n] = idx;
+                    batch.texels[batch.n] = tint_texel(interpolate_texel(diffuse, uv, b0, b1, b2), slot.tint);
+                    batch.intensities[batch.n] = ity[0] * b0 + ity[1] * b1 + ity[2] * b2;
+                    if (++batch.n == FragmentBatch::size)
+                        batch.flush(data, bpp);
+                }
+            }
+        }
+    }
+    batch.flush(data, bpp);
+    return fragments;
+}
+
+InstancedRenderer::Stats InstancedRenderer::render(const std::vector<Instance> &instances, Matrix &transformMatrix,
+                                                   const Vec3f &lightDirection, Framebuffer &framebuffer) {
+    Trace::Span span("instances", static_cast<int64_t>(instances.size()));
+    auto start = std::chrono::steady_clock::now();
+    Stats stats{0, 0, 0, 0};
+    const int width = framebuffer.get_width();
+    const int height = framebuffer.get_height();
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    bins.resize(static_cast<size_t>((width + tileSize - 1) / tileSize) * tilesY);
+
+    float camera[4][4];
+    for (int r = 0; r < 4; ++r)
+        for (int c = 0; c < 4; ++c)
+            camera[r][c] = transformMatrix[r][c];
+
+    ThreadPool &pool = ThreadPool::instance();
+    size_t next = 0;
+    while (next < instances.size()) {
+        int nSlots = 0;
+        while (nSlots < batchInstances && next < instances.size()) {
+            if (setup(instances[next++], camera, lightDirection, width, height, slots[nSlots]))
+                nSlots++;
+            else
+                stats.culled++;
+        }
+        if (!nSlots)
+            break;
+        stats.drawn += nSlots;
+
+        {
+            Trace::Span vertexSpan("instance vertex", nSlots);
+            pool.parallel_for(0, nSlots, 1, [&](int first, int last) {
+                for (int iSlot = first; iSlot < last; ++iSlot)
+                    transform(iSlot, width, height);
+            });
+        }
+        Trace::Span rasterSpan("instance raster", nSlots);
+        std::atomic<long long> fragments(0);
+        pool.parallel_for(0, tilesY, 1, [&](int first, int last) {
+            for (int tileRow = first; tileRow < last; ++tileRow)
+                fragments += raster_row(nSlots, tileRow, framebuffer);
+        });
+        stats.fragments += fragments;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,116 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_INSTANCING_H
+#define SIMPLESOFTWARERENDERER_INSTANCING_H
+
+#include <vector>
+#include "Framebuffer.h"
+#include "Model.h"
+#include "geometry.h"
+
+// One copy of the model: rotation with uniform scale and translation (rows of a 3x4 affine matrix from model to
+// world) and a color the texture is multiplied with.
+struct Instance {
+    float transform[3][4];
+    Vec3f tint;     // r, g, b, 1 keeps the texture
+};
+
+// center of the bounding box and the distance to the farthest vertex from it
+void bounding_sphere(const std::vector<Vec3f> &vertices, Vec3f &center, float &radius);
+
+// camera x instance, the matrix from model to screen
+void instance_matrix(const float camera[4][4], const Instance &instance, float m[4][4]);
+
+// false when the model space sphere is outside the width x height view of the model to screen matrix m, or reaches
+// into the nearest 10% of the camera distance, where copies are dropped rather than clipped
+bool sphere_in_view(const float m[4][4], const Vec3f &center, float radius, int width, int height);
+
+// the tint as 8.8 factors of the b, g, r, a channels (alpha kept), for tint_texel()
+void tint_factors(const Vec3f &tint, uint16_t factors[4]);
+
+inline uint32_t tint_texel(uint32_t texel, const uint16_t factors[4]) {
+    uint32_t tinted = 0;
+    for (int k = 0; k < 4; ++k)
+        tinted |= ((texel >> (8 * k) & 0xff) * factors[k] >> 8) << (8 * k);
+    return tinted;
+}
+
+// yaw in degrees around y
+Instance make_instance(const Vec3f &position, float yaw, float scale, const Vec3f &tint);
+
+// n copies of the model in rows and columns on the xy plane over [-extent, extent]^2, each scaled to fit its cell
+// with a random yaw and tint; the same seed gives the same instances
+void instance_grid(const Model &model, int n, float extent, std::vector<Instance> &instances, unsigned seed = 1);
+
+// Draws many copies of one model in a pass. Positions, normals, corners and texel coordinates are decoded once
+// and shared by all copies; per instance only the vertices are transformed and the light is moved into model
+// space, so the shared normals are lit with one dot product each. Instances whose bounding sphere is outside the
+// view are skipped. The rest are drawn in batches of a fixed number of triangles: the vertices of a batch are
+// transformed in parallel over its instances, then every tile row bins the triangles of the batch into its 64x64
+// tiles and rasterizes them, rows in parallel. Tiles see triangles in instance and face order, so the image does
+// not depend on the thread count, and the working memory depends on the batch size only.
+class InstancedRenderer {
+public:
+    static const int tileSize = 64;
+
+    struct Stats {
+        int drawn;
+        int culled;
+        long long fragments;
+        double seconds;
+    };
+
+    explicit InstancedRenderer(Model *model, int batchTriangles = 1 << 18);
+
+    // instances in front of the camera plane only: copies reaching into the nearest 10% of the camera distance
+    // are dropped rather than clipped
+    Stats render(const std::vector<Instance> &instances, Matrix &transformMatrix, const Vec3f &lightDirection,
+                 Framebuffer &framebuffer);
+
+    // bytes held between frames, the same for any number of instances
+    size_t scratch_bytes() const;
+
+private:
+    struct Bounds {
+        int xMin, yMin, xMax, yMax;     // screen bounding box, empty (xMin > xMax) for culled triangles
+    };
+
+    struct TriangleRef {
+        int slot;
+        int face;
+    };
+
+    struct Slot {
+        float matrix[4][4];     // model to screen
+        Vec3f light;            // light direction in model space
+        uint16_t tint[4];       // 8.8 factor of every channel, b g r a
+    };
+
+    const TGAImage *diffuse;
+    int nVertices, nNormals, nFaces;
+    std::vector<Vec3f> vertices;
+    std::vector<Vec3f> normals;
+    std::vector<Vec3i> corners;         // vertex, uv, normal of every corner, 3 per face
+    std::vector<Vec2i> texels;          // texel coordinates of every corner
+    Vec3f sphereCenter;
+    float sphereRadius;
+
+    int batchInstances;
+    std::vector<Slot> slots;
+    std::vector<Vec3i> screen;          // batchInstances x nVertices
+    std::vector<float> intensities;     // batchInstances x nNormals
+    std::vector<Bounds> bounds;         // batchInstances x nFaces
+    std::vector<std::vector<TriangleRef>> bins;
+
+    // fills the slot of a visible instance, false when it is culled
+    bool setup(const Instance &instance, const float camera[4][4], const Vec3f &lightDirection, int width,
+               int height, Slot &slot) const;
+
+    void transform(int slot, int width, int height);
+
+    long long raster_row(int nSlots, int tileRow, Framebuffer &framebuffer);
+};
+
+#endif //SIMPLESOFTWARERENDERER_INSTANCING_H
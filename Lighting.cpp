@@ -0,0 +1,320 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include "Lighting.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+LightList::LightList() : lights(), direction(0, 0, 1), directionalColor(0, 0, 0) {}
+
+void LightList::set_directional(const Vec3f &lightDirection, const Vec3f &color) {
+    direction = lightDirection;
+    directionalColor = color;
+}
+
+void LightList::add_point(const Vec3f &position, const Vec3f &color, float radius) {
+    lights.push_back(Light{Light::POINT, position, color, radius, Vec3f(0, 0, 1), -1.f, -1.f});
+}
+
+void LightList::add_spot(const Vec3f &position, const Vec3f &axis, const Vec3f &color, float radius,
+                         float outerAngle, float innerAngle) {
+    const float toRadians = float(M_PI) / 180;
+    Vec3f unit = axis;
+    lights.push_back(Light{Light::SPOT, position, color, radius, unit.normalize(), std::cos(outerAngle * toRadians),
+                           std::cos(innerAngle * toRadians)});
+}
+
+void LightList::clear() {
+    lights.clear();
+}
+
+int LightList::size() const {
+    return static_cast<int>(lights.size());
+}
+
+const std::vector<Light> &LightList::get_lights() const {
+    return lights;
+}
+
+const Vec3f &LightList::get_direction() const {
+    return direction;
+}
+
+const Vec3f &LightList::get_directional_color() const {
+    return directionalColor;
+}
+
+LightList LightList::rotated(Matrix rotation) const {
+    Matrix inverse = rotation.transpose();
+    LightList result(*this);
+    result.direction = Vec3f(inverse * Matrix(direction));
+    for (Light &light : result.lights) {
+        light.position = Vec3f(inverse * Matrix(light.position));
+        light.direction = Vec3f(inverse * Matrix(light.direction));
+    }
+    return result;
+}
+
+void scatter_lights(const Model &model, int n, float radius, LightList &lights, unsigned seed) {
+    if (model.nFaces() == 0)
+        return;
+    std::vector<Vec3f> vertices(static_cast<size_t>(model.nVertices()));
+    model.decode_vertices(vertices.data());
+    std::vector<Vec3f> normals(static_cast<size_t>(model.nNormals()));
+    model.decode_normals(normals.data());
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    for (int i = 0; i < n; ++i) {
+        int iFace = static_cast<int>(random() % static_cast<unsigned>(model.nFaces()));
+        float b1 = unit(random), b2 = unit(random);
+        if (b1 + b2 > 1) {
+            b1 = 1 - b1;
+            b2 = 1 - b2;
+        }
+        float b[3] = {1 - b1 - b2, b1, b2};
+        Vec3f position(0, 0, 0), normal(0, 0, 0);
+        for (int k = 0; k < 3; ++k) {
+            Vec3i corner = model.corner(iFace, k);
+            position = position + vertices[corner.x] * b[k];
+            normal = normal + normals[corner.z] * b[k];
+        }
+        normal.normalize();
+        Vec3f color(.2f + .8f * unit(random), .2f + .8f * unit(random), .2f + .8f * unit(random));
+        // a third of the radius off the surface, so the light reaches the area around the spot it hovers over
+        position = position + normal * (radius / 3);
+        if (i % 4 == 3)
+            lights.add_spot(position, normal * -1.f, color, radius, 60.f, 30.f);
+        else
+            lights.add_point(position, color, radius);
+    }
+}
+
+TiledLighting::TiledLighting(int32_t w, int32_t h) : width(w), height(h), tilesX((w + tileSize - 1) / tileSize),
+                                                     tilesY((h + tileSize - 1) / tileSize), albedo(), normals(),
+                                                     positions(), covered(), tileLights(), allLights() {
+    size_t nPixels = static_cast<size_t>(w) * h;
+    albedo.resize(nPixels);
+    normals.resize(nPixels);
+    positions.resize(nPixels);
+    covered.resize(nPixels);
+    tileLights.resize(static_cast<size_t>(tilesX) * tilesY);
+}
+
+void TiledLighting::rasterize(Model *model, Matrix &transformMatrix, Framebuffer &framebuffer, FrameArena &arena) {
+    Trace::Span span("gbuffer", model->nFaces());
+    Vec3f *world = arena.allocate<Vec3f>(static_cast<size_t>(model->nVertices()));
+    Vec3f *screen = arena.allocate<Vec3f>(static_cast<size_t>(model->nVertices()));
+    model->decode_vertices(world);
+    for (int i = 0; i < model->nVertices(); ++i)
+        screen[i] = transformMatrix.transform(world[i]);
+    Vec3f *vertexNormals = arena.allocate<Vec3f>(static_cast<size_t>(model->nNormals()));
+    model->decode_normals(vertexNormals);
+
+    std::fill(covered.begin(), covered.end(), 0);
+    const TGAImage *diffuse = model->get_diffuse_map();
+    int *zBuffer = framebuffer.zBuffer.data();
+
+    for (int iFace = 0; iFace < model->nFaces(); ++iFace) {
+        Vec3i s[3];
+        Vec3f p[3], n[3];
+        Vec2i uv[3];
+        for (int k = 0; k < 3; ++k) {
+            Vec3i corner = model->corner(iFace, k);
+            s[k] = screen[corner.x];
+            p[k] = world[corner.x];
+            n[k] = vertexNormals[corner.z];
+            uv[k] = model->get_uv(iFace, k);
+        }
+        int64_t area = edge(s[0], s[1], s[2].x, s[2].y);
+        if (area == 0)
+            continue;
+        int xMin = std::max(0, std::min(s[0].x, std::min(s[1].x, s[2].x)));
+        int xMax = std::min(width - 1, std::max(s[0].x, std::max(s[1].x, s[2].x)));
+        int yMin = std::max(0, std::min(s[0].y, std::min(s[1].y, s[2].y)));
+        int yMax = std::min(height - 1, std::max(s[0].y, std::max(s[1].y, s[2].y)));
+        const float inverseArea = 1.f / area;
+
+        for (int y = yMin; y <= yMax; ++y) {
+            for (int x = xMin; x <= xMax; ++x) {
+                float b0, b1, b2;
+                barycentric(s, inverseArea, x, y, b0, b1, b2);
+                if (b0 < 0 || b1 < 0 || b2 < 0)
+                    continue;
+                int z = static_cast<int>(b0 * s[0].z + b1 * s[1].z + b2 * s[2].z + .5f);
+                size_t idx = framebuffer.pixel_index(x, y);
+                if (zBuffer[idx] >= z)
+                    continue;
+                zBuffer[idx] = z;
+
+                size_t g = static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+                covered[g] = 1;
+                positions[g] = p[0] * b0 + p[1] * b1 + p[2] * b2;
+                normals[g] = n[0] * b0 + n[1] * b1 + n[2] * b2;
+                albedo[g] = interpolate_texel(diffuse, uv, b0, b1, b2);
+            }
+        }
+    }
+}
+
+int TiledLighting::cull(const LightList &lights, int tileRow) {
+    const std::vector<Light> &all = lights.get_lights();
+    const float inf = std::numeric_limits<float>::infinity();
+    int shown = 0;
+    for (int tx = 0; tx < tilesX; ++tx) {
+        std::vector<int> &list = tileLights[static_cast<size_t>(tileRow) * tilesX + tx];
+        list.clear();
+
+        // bounding box of the surface the tile shows
+        Vec3f lo(inf, inf, inf), hi(-inf, -inf, -inf);
+        int yEnd = std::min(height, (tileRow + 1) * tileSize), xEnd = std::min(width, (tx + 1) * tileSize);
+        for (int y = tileRow * tileSize; y < yEnd; ++y) {
+            for (int x = tx * tileSize; x < xEnd; ++x) {
+                size_t g = static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+                if (!covered[g])
+                    continue;
+                Vec3f p = positions[g];
+                for (int k = 0; k < 3; ++k) {
+                    lo[k] = std::min(lo[k], p[k]);
+                    hi[k] = std::max(hi[k], p[k]);
+                }
+            }
+        }
+        if (lo.x > hi.x)
+            continue;
+        shown++;
+
+        for (size_t i = 0; i < all.size(); ++i) {
+            Vec3f c = all[i].position;
+            float d2 = 0;
+            for (int k = 0; k < 3; ++k) {
+                float d = std::max(lo[k] - c[k], 0.f) + std::max(c[k] - hi[k], 0.f);
+                d2 += d * d;
+            }
+            if (d2 < all[i].radius * all[i].radius)
+                list.push_back(static_cast<int>(i));
+        }
+    }
+    return shown;
+}
+
+long long TiledLighting::shade(const LightList &lights, Framebuffer &framebuffer, int tileRow, bool culling) const {
+    const std::vector<Light> &all = lights.get_lights();
+    const Vec3f direction = lights.get_direction();
+    const Vec3f directionalColor = lights.get_directional_color();
+    uint8_t *data = framebuffer.pixels();
+    const int bpp = framebuffer.color.get_bytesPerPixel();
+    long long evaluations = 0;
+
+    for (int tx = 0; tx < tilesX; ++tx) {
+        const std::vector<int> &list = culling ? tileLights[static_cast<size_t>(tileRow) * tilesX + tx] : allLights;
+        int yEnd = std::min(height, (tileRow + 1) * tileSize), xEnd = std::min(width, (tx + 1) * tileSize);
+        for (int y = tileRow * tileSize; y < yEnd; ++y) {
+            for (int x = tx * tileSize; x < xEnd; ++x) {
+                size_t g = static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+                if (!covered[g])
+                    continue;
+                Vec3f n = normals[g];
+                float length = std::sqrt(n * n);
+                if (length > 0)
+                    n = n * (1 / length);
+                const Vec3f p = positions[g];
+
+                Vec3f sum = directionalColor * std::max(0.f, n * direction);
+                for (int i : list) {
+                    const Light &light = all[i];
+                    Vec3f l = light.position - p;
+                    float d2 = l * l;
+                    float r2 = light.radius * light.radius;
+                    if (d2 >= r2)
+                        continue;
+                    float d = std::sqrt(d2);
+                    l = l * (1 / std::max(d, 1e-6f));
+                    float lambert = n * l;
+                    if (lambert <= 0)
+                        continue;
+                    float falloff = 1 - d2 / r2;
+                    float weight = lambert * falloff * falloff;
+                    if (light.type == Light::SPOT) {
+                        float axis = -(l * light.direction);
+                        if (axis <= light.cosOuter)
+                            continue;
+                        weight *= std::min(1.f, (axis - light.cosOuter) / (light.cosInner - light.cosOuter));
+                    }
+                    sum = sum + light.color * weight;
+                }
+                evaluations += static_cast<long long>(list.size());
+
+                uint32_t texel = albedo[g];
+                uint8_t *pixel = data + framebuffer.pixel_index(x, y) * bpp;
+                // BGR order: blue takes the third color component
+                float channel[3] = {sum.z, sum.y, sum.x};
+                for (int c = 0; c < std::min(bpp, 3); ++c)
+                    pixel[c] = static_cast<uint8_t>(std::min(255.f, ((texel >> (8 * c)) & 0xff) * channel[c]));
+                if (bpp == TGAImage::RGBA)
+                    pixel[3] = static_cast<uint8_t>(texel >> 24);
+            }
+        }
+    }
+    return evaluations;
+}
+
+TiledLighting::Stats TiledLighting::render(Model *model, Matrix &transformMatrix, const LightList &lights,
+                                           Framebuffer &framebuffer, FrameArena &arena, bool culling) {
+    Stats stats{};
+    if (framebuffer.get_width() != width || framebuffer.get_height() != height) {
+        std::cerr << "Framebuffer size does not match the lighting buffers\n";
+        return stats;
+    }
+    const int rowGrain = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    rasterize(model, transformMatrix, framebuffer, arena);
+    stats.gbufferSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    if (culling) {
+        Trace::Span span("light cull", lights.size());
+        std::atomic<int> shown(0);
+        ThreadPool::instance().parallel_for(0, tilesY, rowGrain, [&](int first, int last) {
+            int n = 0;
+            for (int ty = first; ty < last; ++ty)
+                n += cull(lights, ty);
+            shown += n;
+        });
+        long long listed = 0;
+        for (const std::vector<int> &list : tileLights)
+            listed += static_cast<long long>(list.size());
+        stats.lightsPerTile = shown ? double(listed) / shown : 0;
+    } else {
+        allLights.resize(static_cast<size_t>(lights.size()));
+        std::iota(allLights.begin(), allLights.end(), 0);
+        stats.lightsPerTile = lights.size();
+    }
+    stats.cullSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    std::atomic<long long> evaluations(0);
+    {
+        Trace::Span span("light shade", lights.size());
+        ThreadPool::instance().parallel_for(0, tilesY, rowGrain, [&](int first, int last) {
+            long long n = 0;
+            for (int ty = first; ty < last; ++ty)
+                n += shade(lights, framebuffer, ty, culling);
+            evaluations += n;
+        });
+    }
+    stats.shadeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.lightEvaluations = evaluations;
+    return stats;
+}
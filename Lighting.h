@@ -0,0 +1,105 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_LIGHTING_H
+#define SIMPLESOFTWARERENDERER_LIGHTING_H
+
+#include <vector>
+#include "Arena.h"
+#include "Framebuffer.h"
+#include "Model.h"
+#include "geometry.h"
+
+// Point or spot light in model space. Its contribution falls off as (1 - d^2 / radius^2)^2 and is exactly zero
+// from radius on, which is what makes culling by the bounding sphere lossless.
+struct Light {
+    enum Type {
+        POINT, SPOT
+    };
+
+    Type type;
+    Vec3f position;
+    Vec3f color;        // r, g, b intensity, 1 is full
+    float radius;
+    Vec3f direction;    // spot axis (unit)
+    float cosOuter;     // spot cone: nothing outside the outer angle, full inside the inner one
+    float cosInner;
+};
+
+class LightList {
+public:
+    LightList();
+
+    // the light every pixel gets, like the lightDirection of the Gouraud renderer; black by default
+    void set_directional(const Vec3f &direction, const Vec3f &color);
+
+    void add_point(const Vec3f &position, const Vec3f &color, float radius);
+
+    // angles in degrees from the axis
+    void add_spot(const Vec3f &position, const Vec3f &direction, const Vec3f &color, float radius, float outerAngle,
+                  float innerAngle);
+
+    void clear();
+
+    int size() const;
+
+    const std::vector<Light> &get_lights() const;
+
+    const Vec3f &get_direction() const;
+
+    const Vec3f &get_directional_color() const;
+
+    // the lights of a frame whose model is rotated by rotation, moved into model space like the frame light
+    LightList rotated(Matrix rotation) const;
+
+private:
+    std::vector<Light> lights;
+    Vec3f direction;
+    Vec3f directionalColor;
+};
+
+// n lights of the given radius just above the surface of the model, every fourth one a spot pointing at it;
+// the same seed gives the same lights
+void scatter_lights(const Model &model, int n, float radius, LightList &lights, unsigned seed = 1);
+
+// Deferred many-light shading. The model is rasterized into a G-buffer (albedo, normal and position per pixel),
+// the image is cut into tiles and every tile gets the list of lights whose sphere reaches the bounding box of the
+// surface it shows; shading then loops over the tile's list only. Culling and shading run in parallel over tile
+// rows. Without culling every pixel loops over all lights, with the same result.
+class TiledLighting {
+public:
+    static const int tileSize = 16;
+
+    struct Stats {
+        double gbufferSeconds;
+        double cullSeconds;
+        double shadeSeconds;
+        double lightsPerTile;           // average over the tiles that show something
+        long long lightEvaluations;     // lights looked at, summed over the pixels
+    };
+
+    TiledLighting(int32_t w, int32_t h);
+
+    Stats render(Model *model, Matrix &transformMatrix, const LightList &lights, Framebuffer &framebuffer,
+                 FrameArena &arena, bool culling = true);
+
+private:
+    int32_t width, height;
+    int tilesX, tilesY;
+    std::vector<uint32_t> albedo;
+    std::vector<Vec3f> normals;
+    std::vector<Vec3f> positions;
+    std::vector<uint8_t> covered;
+    std::vector<std::vector<int>> tileLights;
+    std::vector<int> allLights;         // the list of every tile without culling
+
+    void rasterize(Model *model, Matrix &transformMatrix, Framebuffer &framebuffer, FrameArena &arena);
+
+    // returns the number of tiles in the row that show some surface
+    int cull(const LightList &lights, int tileRow);
+
+    long long shade(const LightList &lights, Framebuffer &framebuffer, int tileRow, bool culling) const;
+};
+
+#endif //SIMPLESOFTWARERENDERER_LIGHTING_H
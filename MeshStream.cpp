@@ -0,0 +1,317 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MeshStream.h"
+
+static const char magic[4] = {'S', 'S', 'R', 'M'};
+static const uint32_t version = 1;
+
+struct ChunkHeader {
+    uint32_t count;
+    float bboxMin[3];
+    float bboxMax[3];
+};
+
+static void reset_bbox(MeshChunk &chunk) {
+    float inf = std::numeric_limits<float>::max();
+    chunk.bboxMin = Vec3f(inf, inf, inf);
+    chunk.bboxMax = Vec3f(-inf, -inf, -inf);
+}
+
+static void grow_bbox(MeshChunk &chunk, const SoupTriangle &t) {
+    for (const Vec3f &p : t.position) {
+        chunk.bboxMin = Vec3f(std::min(chunk.bboxMin.x, p.x), std::min(chunk.bboxMin.y, p.y),
+                              std::min(chunk.bboxMin.z, p.z));
+        chunk.bboxMax = Vec3f(std::max(chunk.bboxMax.x, p.x), std::max(chunk.bboxMax.y, p.y),
+                              std::max(chunk.bboxMax.z, p.z));
+    }
+}
+
+void ChunkReader::set_filter(ChunkFilter chunkFilter) {
+    filter = std::move(chunkFilter);
+}
+
+ObjChunkReader::ObjChunkReader(const std::string &filename) : filename(filename), in(), mappings(),
+                                                              mappingSizes(), vertices(nullptr), uvs(nullptr),
+                                                              norms(nullptr), nVertices(0), nUvs(0), nNorms(0) {
+    if (!spill_attributes())
+        return;
+    in.open(filename, std::ifstream::in);
+}
+
+ObjChunkReader::~ObjChunkReader() {
+    for (int i = 0; i < 3; ++i) {
+        if (mappings[i])
+            munmap(mappings[i], mappingSizes[i]);
+    }
+}
+
+bool ObjChunkReader::spill_attributes() {
+    std::ifstream obj(filename, std::ifstream::in);
+    if (obj.fail()) {
+        std::cerr << "Failed to open file " << filename << '\n';
+        return false;
+    }
+
+    FILE *spill[3] = {tmpfile(), tmpfile(), tmpfile()};
+    if (!spill[0] || !spill[1] || !spill[2]) {
+        std::cerr << "Can't create the attribute spill files\n";
+        for (FILE *file : spill) {
+            if (file)
+                fclose(file);
+        }
+        return false;
+    }
+    size_t counts[3] = {0, 0, 0};
+    const size_t sizes[3] = {sizeof(Vec3f), sizeof(Vec2f), sizeof(Vec3f)};
+
+    std::string line;
+    while (std::getline(obj, line)) {
+        std::istringstream iss(line);
+        char trash;
+        if (!line.compare(0, 2, "v ")) {
+            iss >> trash;
+            Vec3f v;
+            for (int i = 0; i < 3; ++i)
+                iss >> v[i];
+            fwrite(&v, sizeof(v), 1, spill[0]);
+            counts[0]++;
+        } else if (!line.compare(0, 3, "vt ")) {
+            iss >> trash >> trash;
+            Vec2f uv;
+            for (int i = 0; i < 2; i++)
+                iss >> uv[i];
+            fwrite(&uv, sizeof(uv), 1, spill[1]);
+            counts[1]++;
+        } else if (!line.compare(0, 3, "vn ")) {
+            iss >> trash >> trash;
+            Vec3f n;
+            for (int i = 0; i < 3; i++)
+                iss >> n[i];
+            fwrite(&n, sizeof(n), 1, spill[2]);
+            counts[2]++;
+        }
+    }
+
+    bool is_ok = true;
+    for (int i = 0; i < 3; ++i) {
+        mappingSizes[i] = counts[i] * sizes[i];
+        // a short file (disk full) would fault when the mapping is read past its end
+        struct stat written;
+        if (fflush(spill[i]) || ferror(spill[i]) || fstat(fileno(spill[i]), &written) ||
+            static_cast<size_t>(written.st_size) != mappingSizes[i]) {
+            std::cerr << "Can't write the attribute spill file\n";
+            mappingSizes[i] = 0;
+            is_ok = false;
+        }
+        if (mappingSizes[i]) {
+            // the mapping stays valid after the (already unlinked) file is closed
+            mappings[i] = mmap(nullptr, mappingSizes[i], PROT_READ, MAP_PRIVATE, fileno(spill[i]), 0);
+            if (mappings[i] == MAP_FAILED) {
+                std::cerr << "Can't map the attribute spill file\n";
+                mappings[i] = nullptr;
+                is_ok = false;
+            } else {
+                madvise(mappings[i], mappingSizes[i], MADV_RANDOM);
+            }
+        }
+        fclose(spill[i]);
+    }
+
+    vertices = static_cast<const Vec3f *>(mappings[0]);
+    uvs = static_cast<const Vec2f *>(mappings[1]);
+    norms = static_cast<const Vec3f *>(mappings[2]);
+    nVertices = counts[0];
+    nUvs = counts[1];
+    nNorms = counts[2];
+    std::cerr << "# streaming v# " << nVertices << " vt# " << nUvs << " vn# " << nNorms << std::endl;
+    return is_ok;
+}
+
+bool ObjChunkReader::next(MeshChunk &chunk) {
+    chunk.count = 0;
+    reset_bbox(chunk);
+
+    std::string line;
+    while (chunk.count < chunk.capacity && std::getline(in, line)) {
+        if (line.compare(0, 2, "f "))
+            continue;
+
+        std::istringstream iss(line);
+        char trash;
+        Vec3i corners[3];
+        int n = 0;
+        iss >> trash;
+        Vec3i tmp;
+        while (n < 3 && iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2])
+            corners[n++] = tmp;
+        if (n < 3)
+            continue;
+
+        SoupTriangle &t = chunk.triangles[chunk.count];
+        bool is_ok = true;
+        for (int j = 0; j < 3; ++j) {
+            auto v = static_cast<size_t>(corners[j].x - 1);
+            auto vt = static_cast<size_t>(corners[j].y - 1);
+            auto vn = static_cast<size_t>(corners[j].z - 1);
+            if (v >= nVertices || vt >= nUvs || vn >= nNorms) {
+                is_ok = false;
+                break;
+            }
+            t.position[j] = vertices[v];
+            t.uv[j] = uvs[vt];
+            t.normal[j] = norms[vn];
+        }
+        if (!is_ok) {
+            std::cerr << "Bad face index in " << filename << '\n';
+            continue;
+        }
+        grow_bbox(chunk, t);
+        chunk.count++;
+    }
+    return chunk.count > 0;
+}
+
+bool ObjChunkReader::rewind() {
+    in.clear();
+    in.seekg(0);
+    return in.good();
+}
+
+bool ObjChunkReader::is_open() const {
+    return in.is_open();
+}
+
+std::string ObjChunkReader::texture_file() const {
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos)
+        return {};
+    return filename.substr(0, dot) + "_diffuse.tga";
+}
+
+BinaryChunkReader::BinaryChunkReader(const std::string &filename) : in(nullptr), dataStart(0), textureFile(),
+                                                                    pending(0), bboxMin(), bboxMax() {
+    in = fopen(filename.c_str(), "rb");
+    if (!in) {
+        std::cerr << "Can't open file " << filename << "\n";
+        return;
+    }
+
+    char fileMagic[4];
+    uint32_t fileVersion = 0, textureLength = 0;
+    if (fread(fileMagic, sizeof(fileMagic), 1, in) != 1 || memcmp(fileMagic, magic, sizeof(magic)) != 0 ||
+        fread(&fileVersion, sizeof(fileVersion), 1, in) != 1 || fileVersion != version ||
+        fread(&textureLength, sizeof(textureLength), 1, in) != 1) {
+        std::cerr << "Bad chunked mesh header in " << filename << "\n";
+        fclose(in);
+        in = nullptr;
+        return;
+    }
+
+    textureFile.resize(textureLength);
+    if (textureLength && fread(&textureFile[0], 1, textureLength, in) != textureLength) {
+        std::cerr << "Bad chunked mesh header in " << filename << "\n";
+        fclose(in);
+        in = nullptr;
+        return;
+    }
+    dataStart = ftell(in);
+}
+
+BinaryChunkReader::~BinaryChunkReader() {
+    if (in)
+        fclose(in);
+}
+
+bool BinaryChunkReader::next(MeshChunk &chunk) {
+    chunk.count = 0;
+    if (!in)
+        return false;
+
+    while (!pending) {
+        ChunkHeader header{};
+        if (fread(&header, sizeof(header), 1, in) != 1)
+            return false;
+        bboxMin = Vec3f(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]);
+        bboxMax = Vec3f(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]);
+        if (filter && !filter(bboxMin, bboxMax)) {
+            fseek(in, static_cast<long>(header.count * sizeof(SoupTriangle)), SEEK_CUR);
+            continue;
+        }
+        pending = header.count;
+    }
+
+    chunk.bboxMin = bboxMin;
+    chunk.bboxMax = bboxMax;
+    size_t n = std::min(pending, chunk.capacity);
+    chunk.count = fread(chunk.triangles, sizeof(SoupTriangle), n, in);
+    pending = chunk.count == n ? pending - n : 0;
+    return chunk.count > 0;
+}
+
+bool BinaryChunkReader::rewind() {
+    pending = 0;
+    return in && fseek(in, dataStart, SEEK_SET) == 0;
+}
+
+bool BinaryChunkReader::is_open() const {
+    return in != nullptr;
+}
+
+std::string BinaryChunkReader::texture_file() const {
+    return textureFile;
+}
+
+std::unique_ptr<ChunkReader> open_chunk_reader(const std::string &filename) {
+    size_t dot = filename.find_last_of('.');
+    if (dot != std::string::npos && filename.substr(dot) == ".ssm")
+        return std::unique_ptr<ChunkReader>(new BinaryChunkReader(filename));
+    return std::unique_ptr<ChunkReader>(new ObjChunkReader(filename));
+}
+
+bool write_chunked_mesh(ChunkReader &reader, const std::string &filename, size_t trianglesPerChunk) {
+    FILE *out = fopen(filename.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Can't open file " << filename << "\n";
+        return false;
+    }
+
+    std::string texture = reader.texture_file();
+    auto textureLength = static_cast<uint32_t>(texture.size());
+    fwrite(magic, sizeof(magic), 1, out);
+    fwrite(&version, sizeof(version), 1, out);
+    fwrite(&textureLength, sizeof(textureLength), 1, out);
+    fwrite(texture.data(), 1, texture.size(), out);
+
+    std::vector<SoupTriangle> triangles(trianglesPerChunk);
+    MeshChunk chunk{triangles.data(), 0, trianglesPerChunk, Vec3f(), Vec3f()};
+    size_t total = 0;
+    reader.set_filter(nullptr);
+    reader.rewind();
+    while (reader.next(chunk)) {
+        ChunkHeader header{static_cast<uint32_t>(chunk.count),
+                           {chunk.bboxMin.x, chunk.bboxMin.y, chunk.bboxMin.z},
+                           {chunk.bboxMax.x, chunk.bboxMax.y, chunk.bboxMax.z}};
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(chunk.triangles, sizeof(SoupTriangle), chunk.count, out);
+        total += chunk.count;
+    }
+
+    bool is_ok = !ferror(out);
+    fclose(out);
+    if (!is_ok) {
+        std::cerr << "Can't write the chunked mesh " << filename << "\n";
+        return false;
+    }
+    std::cerr << "# wrote " << total << " triangles to " << filename << std::endl;
+    return true;
+}
@@ -0,0 +1,112 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_MESHSTREAM_H
+#define SIMPLESOFTWARERENDERER_MESHSTREAM_H
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include "geometry.h"
+
+// Self-contained triangle: a chunk of these can be drawn without any vertex arrays
+struct SoupTriangle {
+    Vec3f position[3];
+    Vec2f uv[3];
+    Vec3f normal[3];
+};
+
+struct MeshChunk {
+    SoupTriangle *triangles;
+    size_t count;
+    size_t capacity;
+    Vec3f bboxMin, bboxMax;
+};
+
+// Reads a mesh as a sequence of bounded chunks of triangles
+class ChunkReader {
+public:
+    // given the bounding box of a chunk, says whether its triangles are needed at all
+    typedef std::function<bool(const Vec3f &bboxMin, const Vec3f &bboxMax)> ChunkFilter;
+
+    virtual ~ChunkReader() = default;
+
+    // fills up to chunk.capacity triangles, false at the end of the mesh
+    virtual bool next(MeshChunk &chunk) = 0;
+
+    virtual bool rewind() = 0;
+
+    virtual bool is_open() const = 0;
+
+    // the file of the diffuse texture, empty if unknown
+    virtual std::string texture_file() const = 0;
+
+    // readers that know chunk bounds up front skip chunks rejected by the filter without reading them
+    void set_filter(ChunkFilter filter);
+
+protected:
+    ChunkFilter filter;
+};
+
+// Streams the faces of an OBJ file. The vertex attributes are spilled into an unlinked temporary file
+// in a first pass and mapped back read-only, so they are paged by the kernel instead of living on the heap.
+class ObjChunkReader : public ChunkReader {
+public:
+    explicit ObjChunkReader(const std::string &filename);
+
+    ~ObjChunkReader() override;
+
+    bool next(MeshChunk &chunk) override;
+
+    bool rewind() override;
+
+    bool is_open() const override;
+
+    std::string texture_file() const override;
+
+private:
+    std::string filename;
+    std::ifstream in;
+    void *mappings[3];
+    size_t mappingSizes[3];
+    const Vec3f *vertices;
+    const Vec2f *uvs;
+    const Vec3f *norms;
+    size_t nVertices, nUvs, nNorms;
+
+    bool spill_attributes();
+};
+
+// Reads the chunked binary format written by write_chunked_mesh(): a header with the texture file name,
+// then chunks of raw SoupTriangles, each prefixed with its triangle count and bounding box.
+class BinaryChunkReader : public ChunkReader {
+public:
+    explicit BinaryChunkReader(const std::string &filename);
+
+    ~BinaryChunkReader() override;
+
+    bool next(MeshChunk &chunk) override;
+
+    bool rewind() override;
+
+    bool is_open() const override;
+
+    std::string texture_file() const override;
+
+private:
+    FILE *in;
+    long dataStart;
+    std::string textureFile;
+    size_t pending;   // triangles of the current chunk not handed out yet
+    Vec3f bboxMin, bboxMax;
+};
+
+// reader for the file, chosen by its extension (.ssm is the chunked binary format, anything else is OBJ)
+std::unique_ptr<ChunkReader> open_chunk_reader(const std::string &filename);
+
+bool write_chunked_mesh(ChunkReader &reader, const std::string &filename, size_t trianglesPerChunk = 65536);
+
+#endif //SIMPLESOFTWARERENDERER_MESHSTREAM_H
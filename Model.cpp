@@ -4,12 +4,23 @@
 // Created by ju5t on 29.01.19.
 //
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "Model.h"
 
-Model::Model(const char *filename) : vertices(), faces(), norms(), uvs(), diffuseMap() {
+Model::Model(const char *filename) : vertices(), faces(), norms(), uvs(), diffuseMap(), normalMap(), specularMap(),
+                                     isCompact(false), nVerts(0), nFacesCompact(0), qx(), qy(), qz(), boxMin(),
+                                     boxStep(), octNormals(), qu(), qv(), indices16(), indices32() {
+    // textures are decoded by the cache in the background while we are parsing the geometry
+    TextureCache::PendingTexture diffuse = load_texture(filename, "_diffuse.tga");
+    TextureCache::PendingTexture normal = load_texture(filename, "_nm.tga");
+    TextureCache::PendingTexture specular = load_texture(filename, "_spec.tga");
+
     std::ifstream in;
     in.open(filename, std::ifstream::in);
     if (in.fail()) {
@@ -58,52 +69,318 @@ Model::Model(const char *filename) : vertices(), faces(), norms(), uvs(), diffus
 
     std::cerr << "# v# " << vertices.size() << " f# " << faces.size() << " vt# " << uvs.size() << " vn# "
               << norms.size() << std::endl;
-    load_texture(filename, "_diffuse.tga", diffuseMap);
+    normalize_normals();
+
+    diffuseMap = diffuse.get();
+    normalMap = normal.get();
+    specularMap = specular.get();
+}
+
+Model::Model(std::vector<Vec3f> vertices, std::vector<Vec2f> uvs, std::vector<Vec3f> norms,
+             std::vector<std::vector<Vec3i>> faces, TextureCache::Texture diffuseMap)
+        : vertices(std::move(vertices)), faces(std::move(faces)), norms(std::move(norms)), uvs(std::move(uvs)),
+          diffuseMap(std::move(diffuseMap)), normalMap(), specularMap(), isCompact(false), nVerts(0),
+          nFacesCompact(0), qx(), qy(), qz(), boxMin(), boxStep(), octNormals(), qu(), qv(), indices16(),
+          indices32() {
+    normalize_normals();
+}
+
+void Model::normalize_normals() {
+    for (Vec3f &n : norms)
+        n.normalize();
+}
+
+static uint16_t snorm16(float v) {
+    return static_cast<uint16_t>(static_cast<int16_t>(std::lround(std::max(-1.f, std::min(1.f, v)) * 32767.f)));
+}
+
+static uint16_t unorm16(float v) {
+    return static_cast<uint16_t>(std::lround(std::max(0.f, std::min(1.f, v)) * 65535.f));
+}
+
+// octahedral mapping: project on |x| + |y| + |z| = 1 and fold the lower half over the upper one
+static uint32_t encode_octahedral(const Vec3f &n) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.f)
+        return 0;
+    float x = n.x / l1, y = n.y / l1;
+    if (n.z < 0) {
+        float folded = (1 - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+        y = (1 - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+        x = folded;
+    }
+    return snorm16(x) | uint32_t(snorm16(y)) << 16;
+}
+
+// branch-free (selects only) so loops over many normals vectorize
+static Vec3f decode_octahedral(uint32_t encoded) {
+    float x = static_cast<int16_t>(encoded & 0xffff) / 32767.f;
+    float y = static_cast<int16_t>(encoded >> 16) / 32767.f;
+    float z = 1 - std::abs(x) - std::abs(y);
+    float t = std::max(-z, 0.f);
+    x += x >= 0 ? -t : t;
+    y += y >= 0 ? -t : t;
+    return Vec3f(x, y, z).normalize();
+}
+
+void Model::compact(bool quantizePositions) {
+    if (isCompact)
+        return;
+    isCompact = true;
+    nVerts = static_cast<int>(vertices.size());
+    nFacesCompact = static_cast<int>(faces.size());
+
+    if (quantizePositions && !vertices.empty()) {
+        Vec3f boxMax = vertices[0];
+        boxMin = vertices[0];
+        for (Vec3f v : vertices) {
+            for (int i = 0; i < 3; ++i) {
+                boxMin[i] = std::min(boxMin[i], v[i]);
+                boxMax[i] = std::max(boxMax[i], v[i]);
+            }
+        }
+        boxStep = (boxMax - boxMin) * (1.f / 65535);
+        std::vector<uint16_t> *q[3] = {&qx, &qy, &qz};
+        for (int i = 0; i < 3; ++i) {
+            q[i]->resize(vertices.size());
+            for (size_t k = 0; k < vertices.size(); ++k)
+                (*q[i])[k] = boxStep[i] > 0 ? unorm16((vertices[k][i] - boxMin[i]) / (boxMax[i] - boxMin[i])) : 0;
+        }
+        std::vector<Vec3f>().swap(vertices);
+    }
+
+    octNormals.resize(norms.size());
+    for (size_t k = 0; k < norms.size(); ++k)
+        octNormals[k] = encode_octahedral(norms[k]);
+    // unorm16 clamps to [0, 1], wrapped or tiled texture coordinates stay floats so both layouts draw the same
+    bool uvsInRange = true;
+    for (const Vec2f &uv : uvs)
+        uvsInRange = uvsInRange && uv.x >= 0 && uv.x <= 1 && uv.y >= 0 && uv.y <= 1;
+    if (uvsInRange) {
+        qu.resize(uvs.size());
+        qv.resize(uvs.size());
+        for (size_t k = 0; k < uvs.size(); ++k) {
+            qu[k] = unorm16(uvs[k].x);
+            qv[k] = unorm16(uvs[k].y);
+        }
+    } else {
+        std::cerr << "# compact: uvs outside [0, 1], kept as floats" << std::endl;
+    }
+
+    // only the first three corners are kept, the renderer draws triangles
+    bool narrow = std::max(static_cast<size_t>(nVerts), std::max(uvs.size(), norms.size())) <= 65536;
+    size_t nIndices = faces.size() * 9;
+    narrow ? indices16.reserve(nIndices) : indices32.reserve(nIndices);
+    for (const std::vector<Vec3i> &face : faces) {
+        for (int n = 0; n < 3; ++n) {
+            Vec3i c = face[n];
+            for (int i = 0; i < 3; ++i) {
+                if (narrow)
+                    indices16.push_back(static_cast<uint16_t>(c[i]));
+                else
+                    indices32.push_back(static_cast<uint32_t>(c[i]));
+            }
+        }
+    }
+
+    std::vector<std::vector<Vec3i>>().swap(faces);
+    std::vector<Vec3f>().swap(norms);
+    if (uvsInRange)
+        std::vector<Vec2f>().swap(uvs);
+}
+
+bool Model::is_compact() const {
+    return isCompact;
+}
+
+size_t Model::attribute_bytes() const {
+    size_t bytes = vertices.capacity() * sizeof(Vec3f) + norms.capacity() * sizeof(Vec3f) +
+                   uvs.capacity() * sizeof(Vec2f) + faces.capacity() * sizeof(std::vector<Vec3i>);
+    for (const std::vector<Vec3i> &face : faces)
+        bytes += face.capacity() * sizeof(Vec3i);
+    bytes += (qx.capacity() + qy.capacity() + qz.capacity() + qu.capacity() + qv.capacity()) * sizeof(uint16_t);
+    bytes += octNormals.capacity() * sizeof(uint32_t);
+    bytes += indices16.capacity() * sizeof(uint16_t) + indices32.capacity() * sizeof(uint32_t);
+    return bytes;
 }
 
 int Model::nVertices() const {
-    return static_cast<int>(vertices.size());
+    return isCompact ? nVerts : static_cast<int>(vertices.size());
 }
 
 int Model::nFaces() const {
-    return static_cast<int>(faces.size());
+    return isCompact ? nFacesCompact : static_cast<int>(faces.size());
+}
+
+int Model::nNormals() const {
+    return static_cast<int>(isCompact ? octNormals.size() : norms.size());
 }
 
 Vec3f Model::get_vertex(const int &idx) const {
-    return vertices[idx];
+    if (qx.empty())
+        return vertices[idx];
+    return {boxMin.x + qx[idx] * boxStep.x, boxMin.y + qy[idx] * boxStep.y, boxMin.z + qz[idx] * boxStep.z};
+}
+
+void Model::decode_vertices(Vec3f *out) const {
+    if (qx.empty()) {
+        std::copy(vertices.begin(), vertices.end(), out);
+        return;
+    }
+    const uint16_t *x = qx.data(), *y = qy.data(), *z = qz.data();
+    for (int i = 0; i < nVerts; ++i)
+        out[i] = Vec3f(boxMin.x + x[i] * boxStep.x, boxMin.y + y[i] * boxStep.y, boxMin.z + z[i] * boxStep.z);
+}
+
+void Model::decode_normals(Vec3f *out) const {
+    if (!isCompact) {
+        std::copy(norms.begin(), norms.end(), out);
+        return;
+    }
+    const uint32_t *encoded = octNormals.data();
+    for (size_t i = 0; i < octNormals.size(); ++i)
+        out[i] = decode_octahedral(encoded[i]);
+}
+
+Model *Model::clustered(int gridCells, std::vector<int> &sourceFaces) const {
+    std::vector<Vec3f> positions(static_cast<size_t>(nVertices()));
+    decode_vertices(positions.data());
+    std::vector<Vec3f> normals(static_cast<size_t>(nNormals()));
+    decode_normals(normals.data());
+    std::vector<Vec2f> texcoords = uvs;
+    if (isCompact) {
+        for (size_t i = 0; i < qu.size(); ++i)
+            texcoords.emplace_back(qu[i] * (1.f / 65535), qv[i] * (1.f / 65535));
+    }
+
+    Vec3f lo = positions.empty() ? Vec3f() : positions[0], hi = lo;
+    for (Vec3f v : positions) {
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::min(lo[i], v[i]);
+            hi[i] = std::max(hi[i], v[i]);
+        }
+    }
+    float extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    float scale = extent > 0 ? gridCells / extent : 0.f;
+
+    std::unordered_map<int64_t, int> cells;
+    std::vector<Vec3f> sums;
+    std::vector<int> counts;
+    std::vector<int> cluster(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        int64_t key = 0;
+        for (int k = 0; k < 3; ++k)
+            key = key * (gridCells + 1) + static_cast<int64_t>((positions[i][k] - lo[k]) * scale);
+        auto inserted = cells.emplace(key, static_cast<int>(sums.size()));
+        if (inserted.second) {
+            sums.emplace_back(0, 0, 0);
+            counts.push_back(0);
+        }
+        cluster[i] = inserted.first->second;
+        sums[cluster[i]] = sums[cluster[i]] + positions[i];
+        counts[cluster[i]]++;
+    }
+    for (size_t c = 0; c < sums.size(); ++c)
+        sums[c] = sums[c] * (1.f / counts[c]);
+
+    // a face and its mirror collapse to the same cluster triple, one of them is enough without backface culling
+    std::unordered_set<uint64_t> kept;
+    bool dedupe = sums.size() < (1u << 21);
+    std::vector<std::vector<Vec3i>> lodFaces;
+    sourceFaces.clear();
+    for (int iFace = 0; iFace < nFaces(); ++iFace) {
+        std::vector<Vec3i> face(3);
+        int c[3];
+        for (int n = 0; n < 3; ++n) {
+            face[n] = corner(iFace, n);
+            c[n] = face[n].x = cluster[face[n].x];
+        }
+        if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2])
+            continue;
+        std::sort(c, c + 3);
+        if (dedupe && !kept.insert(uint64_t(c[0]) << 42 | uint64_t(c[1]) << 21 | uint64_t(c[2])).second)
+            continue;
+        lodFaces.push_back(face);
+        sourceFaces.push_back(iFace);
+    }
+    return new Model(sums, texcoords, normals, lodFaces, diffuseMap);
+}
+
+Vec3i Model::corner(int iFace, int nVertex) const {
+    if (!isCompact)
+        return faces[iFace][nVertex];
+    size_t k = (static_cast<size_t>(iFace) * 3 + nVertex) * 3;
+    if (!indices16.empty())
+        return {indices16[k], indices16[k + 1], indices16[k + 2]};
+    return {int(indices32[k]), int(indices32[k + 1]), int(indices32[k + 2])};
 }
 
 std::vector<int> Model::get_face(const int &idx) {
     std::vector<int> face;
 
+    if (isCompact) {
+        for (int n = 0; n < 3; ++n)
+            face.push_back(corner(idx, n).x);
+        return face;
+    }
     for (auto &i : faces[idx])
         face.push_back(i[0]);
 
     return face;
 }
 
-void Model::load_texture(std::string filename, std::string suffix, TGAImage &img) {
-    size_t dot = filename.find_last_of('.');
-    if (dot != std::string::npos) {
-        std::string textureFile = filename.substr(0, dot) + suffix;
+int Model::vert(int iFace, int nVertex) const {
+    return corner(iFace, nVertex).x;
+}
 
-        bool is_ok = img.read_tga_file(textureFile);
-        std::cerr << "texture file " << textureFile << " loading " << (is_ok ? "ok" : "failed") << std::endl;
-        img.flip_vertically();
+TextureCache::PendingTexture Model::load_texture(std::string filename, std::string suffix) {
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos) {
+        std::promise<TextureCache::Texture> none;
+        none.set_value(nullptr);
+        return none.get_future().share();
     }
+    return TextureCache::instance().request(filename.substr(0, dot) + suffix);
 }
 
 Vec2i Model::get_uv(int iFace, int nVertex) {
-    int idx = faces[iFace][nVertex][1];
-    return {static_cast<int>(uvs[idx].x * diffuseMap.get_width()),
-            static_cast<int>(uvs[idx].y * diffuseMap.get_height())};
+    int idx = corner(iFace, nVertex).y;
+    if (!diffuseMap)
+        return {};
+    if (isCompact && uvs.empty())
+        return {static_cast<int>(qu[idx] * (1.f / 65535) * diffuseMap->get_width()),
+                static_cast<int>(qv[idx] * (1.f / 65535) * diffuseMap->get_height())};
+    return {static_cast<int>(uvs[idx].x * diffuseMap->get_width()),
+            static_cast<int>(uvs[idx].y * diffuseMap->get_height())};
 }
 
 TGAColor Model::get_diffuse(Vec2i uv) {
-    return diffuseMap.get(uv.x, uv.y);
+    if (!diffuseMap)
+        return {};
+    return diffuseMap->get(uv.x, uv.y);
+}
+
+const TGAImage *Model::get_diffuse_map() const {
+    return diffuseMap.get();
+}
+
+Vec3f Model::get_normal(Vec2i uv) {
+    if (!normalMap)
+        return {};
+    TGAColor c = normalMap->get(uv.x, uv.y);
+    Vec3f res;
+    for (int i = 0; i < 3; i++)
+        res[2 - i] = c.bgra[i] / 255.f * 2.f - 1.f;
+    return res;
+}
+
+float Model::get_specular(Vec2i uv) {
+    if (!specularMap)
+        return 0.f;
+    return specularMap->get(uv.x, uv.y).bgra[0];
 }
 
 Vec3f Model::get_norm(int iFace, int nVertex) {
-    int idx = faces[iFace][nVertex][2];
-    return norms[idx].normalize();
+    int idx = corner(iFace, nVertex).z;
+    return isCompact ? decode_octahedral(octNormals[idx]) : norms[idx];
 }
\ No newline at end of file
@@ -5,38 +5,98 @@
 #ifndef SIMPLESOFTWARERENDERER_MODEL_H
 #define SIMPLESOFTWARERENDERER_MODEL_H
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "geometry.h"
 #include "TGAImage.h"
+#include "TextureCache.h"
 
+// Mesh with either the float layout the OBJ is parsed into or, after compact(), a quantized one:
+// normals octahedral-encoded in 32 bits, uvs as 16-bit unorm, corner indices in 16 bits when they fit and
+// optionally positions as 16 bits per axis over the bounding box. Normals are normalized once at load in both.
+// A 16-bit unorm only holds [0, 1]: the uvs of a model with wrapped or tiled texture coordinates stay floats.
 class Model {
 private:
     std::vector<Vec3f> vertices;
     std::vector<std::vector<Vec3i>> faces; // attention, this Vec3i means vertex/uv/normal
     std::vector<Vec3f> norms;
     std::vector<Vec2f> uvs;
-    TGAImage diffuseMap;
+    TextureCache::Texture diffuseMap;
+    TextureCache::Texture normalMap;
+    TextureCache::Texture specularMap;
 
-    void load_texture(std::string filename, std::string suffix, TGAImage &img);
+    // compact layout, the attribute arrays are kept separate (x, y, z apart) so decoding runs over plain arrays
+    bool isCompact;
+    int nVerts, nFacesCompact;
+    std::vector<uint16_t> qx, qy, qz;   // empty if the positions stay in vertices
+    Vec3f boxMin, boxStep;
+    std::vector<uint32_t> octNormals;
+    std::vector<uint16_t> qu, qv;       // empty if the uvs stay in uvs
+    std::vector<uint16_t> indices16;    // vertex/uv/normal of every corner, 9 per face
+    std::vector<uint32_t> indices32;    // the same when an index does not fit in 16 bits
+
+    static TextureCache::PendingTexture load_texture(std::string filename, std::string suffix);
+
+    void normalize_normals();
 
 public:
     explicit Model(const char *filename);
 
+    // mesh built in memory (e.g. by the scene generator), faces hold vertex/uv/normal indices like the OBJ ones
+    Model(std::vector<Vec3f> vertices, std::vector<Vec2f> uvs, std::vector<Vec3f> norms,
+          std::vector<std::vector<Vec3i>> faces, TextureCache::Texture diffuseMap);
+
     ~Model() = default;
 
+    // switches to the compact layout and frees the float arrays it replaces
+    void compact(bool quantizePositions);
+
+    bool is_compact() const;
+
+    // memory held by positions, normals, uvs and face indices
+    size_t attribute_bytes() const;
+
     int nVertices() const;
 
     int nFaces() const;
 
+    int nNormals() const;
+
+    // vertex/uv/normal indices of the nVertex-th corner of the face
+    Vec3i corner(int iFace, int nVertex) const;
+
+    // all positions, resp. all normals, in index order
+    void decode_vertices(Vec3f *out) const;
+
+    void decode_normals(Vec3f *out) const;
+
+    // level of detail by vertex clustering: the bounding box is cut into gridCells^3 cells, the vertices of a cell
+    // merge into their mean and faces that collapse (or duplicate another one) are dropped. sourceFaces gets the
+    // face of this model every kept face came from. Uvs, normals and the diffuse texture stay shared.
+    Model *clustered(int gridCells, std::vector<int> &sourceFaces) const;
+
     Vec3f get_vertex(const int &idx) const;
 
     std::vector<int> get_face(const int &idx);
 
+    // vertex index of the nVertex-th corner of the face, get_face() without the vector
+    int vert(int iFace, int nVertex) const;
+
     Vec2i get_uv(int iFace, int nVertex);
 
     Vec3f get_norm(int iFace, int nVertex);
 
     TGAColor get_diffuse(Vec2i uv);
+
+    // nullptr if the model has no diffuse texture
+    const TGAImage *get_diffuse_map() const;
+
+    // tangent-less normal from the _nm.tga map, (0, 0, 0) if the model has no normal map
+    Vec3f get_normal(Vec2i uv);
+
+    // specular exponent from the _spec.tga map, 0 if the model has no specular map
+    float get_specular(Vec2i uv);
 };
 
 #endif //SIMPLESOFTWARERENDERER_MODEL_H
@@ -0,0 +1,74 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "PerfCounters.h"
+
+static int open_counter(uint64_t cache, uint64_t result) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | result << 16;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+PerfCounters::PerfCounters() : fds(), values() {
+    fds[L1D_MISSES] = open_counter(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS);
+    fds[LLC_MISSES] = open_counter(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS);
+    fds[DTLB_MISSES] = open_counter(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS);
+    for (int64_t &value : values)
+        value = -1;
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : fds) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+bool PerfCounters::is_available() const {
+    for (int fd : fds) {
+        if (fd >= 0)
+            return true;
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void PerfCounters::stop() {
+    for (int i = 0; i < N_COUNTERS; ++i) {
+        values[i] = -1;
+        if (fds[i] < 0)
+            continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count;
+        if (read(fds[i], &count, sizeof(count)) == sizeof(count))
+            values[i] = static_cast<int64_t>(count);
+    }
+}
+
+int64_t PerfCounters::get(Counter counter) const {
+    return values[counter];
+}
+
+const char *PerfCounters::name(Counter counter) {
+    static const char *names[N_COUNTERS] = {"L1D misses", "LLC misses", "dTLB misses"};
+    return names[counter];
+}
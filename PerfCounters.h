@@ -0,0 +1,41 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_PERFCOUNTERS_H
+#define SIMPLESOFTWARERENDERER_PERFCOUNTERS_H
+
+#include <cstdint>
+
+// Hardware cache and TLB miss counters of the calling thread (Linux perf_event_open, user space only).
+// Counters the kernel or the machine does not provide stay closed and read as -1.
+class PerfCounters {
+public:
+    enum Counter {
+        L1D_MISSES, LLC_MISSES, DTLB_MISSES, N_COUNTERS
+    };
+
+    PerfCounters();
+
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool is_available() const;
+
+    void start();
+
+    void stop();
+
+    int64_t get(Counter counter) const;
+
+    static const char *name(Counter counter);
+
+private:
+    int fds[N_COUNTERS];
+    int64_t values[N_COUNTERS];
+};
+
+#endif //SIMPLESOFTWARERENDERER_PERFCOUNTERS_H
@@ -0,0 +1,132 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "Progressive.h"
+#include "Renderer.h"
+#include "Trace.h"
+
+// a LOD that keeps more than this share of the faces is not worth drawing instead of the model
+static const float lodMaxFaces = .75f;
+
+ProgressiveRenderer::ProgressiveRenderer(Model *model, int32_t w, int32_t h, int coarsest, Framebuffer::Layout layout)
+        : model(model), passes(), faceIds(), visible(), order(), arena(), lodSeconds(0) {
+    auto start = std::chrono::steady_clock::now();
+    Trace::Span span("lod");
+    for (int scale = coarsest; scale >= 1; scale /= 2) {
+        Pass pass;
+        pass.scale = scale;
+        pass.framebuffer.reset(new Framebuffer((w + scale - 1) / scale, (h + scale - 1) / scale, TGAImage::RGB,
+                                               layout));
+        if (scale > 1) {
+            // the model covers about three quarters of the image, a cluster of about two pixels of the pass
+            int gridCells = std::max(4, pass.framebuffer->get_width() * 3 / 8);
+            pass.lod.reset(model->clustered(gridCells, pass.sourceFaces));
+            std::cerr << "# progressive 1/" << scale << " LOD " << gridCells << " cells: " << pass.lod->nFaces()
+                      << " of " << model->nFaces() << " faces" << std::endl;
+            if (pass.lod->nFaces() > lodMaxFaces * model->nFaces()) {
+                pass.lod.reset();
+                pass.sourceFaces.clear();
+            }
+        }
+        passes.push_back(std::move(pass));
+    }
+    lodSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int ProgressiveRenderer::get_passes() const {
+    return static_cast<int>(passes.size());
+}
+
+double ProgressiveRenderer::get_lod_seconds() const {
+    return lodSeconds;
+}
+
+ProgressiveRenderer::Stats ProgressiveRenderer::render(const Matrix &transformMatrix, const Vec3f &lightDirection,
+                                                       const Emit &emit) {
+    auto start = std::chrono::steady_clock::now();
+    Stats stats{};
+    visible.clear();
+    for (size_t i = 0; i < passes.size(); ++i) {
+        Pass &pass = passes[i];
+        {
+            Trace::Span span("pass", pass.scale);
+            pass.framebuffer->clear();
+            stats.fragments += draw(pass, transformMatrix, lightDirection, i + 1 < passes.size());
+            pass.framebuffer->resolve();
+        }
+        emit(*pass.framebuffer, pass.scale);
+        if (i == 0)
+            stats.firstImageSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    stats.totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+long long ProgressiveRenderer::draw(Pass &pass, Matrix transformMatrix, const Vec3f &lightDirection,
+                                    bool recordVisibility) {
+    Model *drawn = pass.lod ? pass.lod.get() : model;
+    Framebuffer &framebuffer = *pass.framebuffer;
+    arena.reset();
+
+    // scaling the x and y rows scales the projected coordinates the same way
+    for (int j = 0; j < 4; ++j) {
+        transformMatrix[0][j] /= pass.scale;
+        transformMatrix[1][j] /= pass.scale;
+    }
+
+    Vec3f *screen = arena.allocate<Vec3f>(static_cast<size_t>(drawn->nVertices()));
+    drawn->decode_vertices(screen);
+    for (int i = 0; i < drawn->nVertices(); ++i)
+        screen[i] = transformMatrix.transform(screen[i]);
+    Vec3f *normals = arena.allocate<Vec3f>(static_cast<size_t>(drawn->nNormals()));
+    float *intensities = arena.allocate<float>(static_cast<size_t>(drawn->nNormals()));
+    drawn->decode_normals(normals);
+    for (int i = 0; i < drawn->nNormals(); ++i)
+        intensities[i] = normals[i] * lightDirection;
+
+    // the faces seen in the previous pass first, they are likely to occlude the rest
+    auto source = [&pass](int iFace) { return pass.lod ? pass.sourceFaces[iFace] : iFace; };
+    order.clear();
+    if (!visible.empty()) {
+        for (int iFace = 0; iFace < drawn->nFaces(); ++iFace) {
+            if (visible[source(iFace)])
+                order.push_back(iFace);
+        }
+    }
+    for (int iFace = 0; iFace < drawn->nFaces(); ++iFace) {
+        if (visible.empty() || !visible[source(iFace)])
+            order.push_back(iFace);
+    }
+
+    int *ids = nullptr;
+    if (recordVisibility) {
+        faceIds.assign(framebuffer.pixel_count(), -1);
+        ids = faceIds.data();
+    }
+    long long fragments = 0;
+    for (int iFace : order) {
+        Vec3i screen_c[3];
+        Vec2i uv[3];
+        float intensity[3];
+        for (int jVertex = 0; jVertex < 3; ++jVertex) {
+            Vec3i corner = drawn->corner(iFace, jVertex);
+            screen_c[jVertex] = screen[corner.x];
+            intensity[jVertex] = intensities[corner.z];
+            uv[jVertex] = drawn->get_uv(iFace, jVertex);
+        }
+        fragments += triangle(screen_c, uv, intensity, drawn->get_diffuse_map(), framebuffer, ids, iFace);
+    }
+
+    if (recordVisibility) {
+        visible.assign(static_cast<size_t>(model->nFaces()), 0);
+        for (int id : faceIds) {
+            if (id >= 0)
+                visible[source(id)] = 1;
+        }
+    }
+    return fragments;
+}
@@ -0,0 +1,66 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_PROGRESSIVE_H
+#define SIMPLESOFTWARERENDERER_PROGRESSIVE_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Arena.h"
+#include "Framebuffer.h"
+#include "Model.h"
+#include "geometry.h"
+
+// Progressive preview: a frame is drawn in passes from 1/coarsest of the resolution up to the full one and every
+// pass is handed out as soon as it is done. Passes below full resolution draw a vertex-clustered LOD of the model
+// when that saves faces. Each pass records which faces won a pixel and the next one draws those first, so the
+// depth test rejects most hidden fragments before they are shaded.
+class ProgressiveRenderer {
+public:
+    struct Stats {
+        double firstImageSeconds;   // from the start of the frame until the first pass was emitted
+        double totalSeconds;
+        long long fragments;
+    };
+
+    // gets every pass, resolved, with its scale (1 for the last one)
+    typedef std::function<void(const Framebuffer &pass, int scale)> Emit;
+
+    // coarsest is a power of two, the passes are drawn at 1/coarsest, 1/(coarsest/2), ..., 1 of w x h
+    ProgressiveRenderer(Model *model, int32_t w, int32_t h, int coarsest,
+                        Framebuffer::Layout layout = Framebuffer::LINEAR);
+
+    ProgressiveRenderer(const ProgressiveRenderer &) = delete;
+
+    ProgressiveRenderer &operator=(const ProgressiveRenderer &) = delete;
+
+    // transformMatrix is the full resolution one, each pass scales it down
+    Stats render(const Matrix &transformMatrix, const Vec3f &lightDirection, const Emit &emit);
+
+    int get_passes() const;
+
+    // time the constructor spent building the LODs
+    double get_lod_seconds() const;
+
+private:
+    struct Pass {
+        int scale;
+        std::unique_ptr<Framebuffer> framebuffer;
+        std::unique_ptr<Model> lod;     // nullptr: the pass draws the full model
+        std::vector<int> sourceFaces;   // full model face of every LOD face
+    };
+
+    Model *model;
+    std::vector<Pass> passes;
+    std::vector<int> faceIds;           // winning face per pixel of the current pass, -1 where nothing was drawn
+    std::vector<uint8_t> visible;       // full model faces that won a pixel in the previous pass
+    std::vector<int> order;
+    FrameArena arena;
+    double lodSeconds;
+
+    long long draw(Pass &pass, Matrix transformMatrix, const Vec3f &lightDirection, bool recordVisibility);
+};
+
+#endif //SIMPLESOFTWARERENDERER_PROGRESSIVE_H
@@ -0,0 +1,466 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "Arena.h"
+#include "FrameBudget.h"
+#include "Framebuffer.h"
+#include "Instancing.h"
+#include "Model.h"
+#include "Regression.h"
+#include "Renderer.h"
+#include "RetainedScene.h"
+
+struct Scene {
+    std::string name;
+    std::string objFile;
+};
+
+ImageDiff compare_images(const TGAImage &a, const TGAImage &b, int tolerance) {
+    ImageDiff diff{false, 0, 0};
+    if (a.get_width() != b.get_width() || a.get_height() != b.get_height() ||
+        a.get_bytesPerPixel() != b.get_bytesPerPixel() || !a.buffer() || !b.buffer())
+        return diff;
+    diff.sameShape = true;
+
+    const int bpp = a.get_bytesPerPixel();
+    const size_t nPixels = static_cast<size_t>(a.get_width()) * a.get_height();
+    for (size_t i = 0; i < nPixels; ++i) {
+        int pixelDifference = 0;
+        for (int c = 0; c < bpp; ++c)
+            pixelDifference = std::max(pixelDifference, std::abs(a.buffer()[i * bpp + c] - b.buffer()[i * bpp + c]));
+        diff.maxDifference = std::max(diff.maxDifference, pixelDifference);
+        if (pixelDifference > tolerance)
+            diff.differingPixels++;
+    }
+    return diff;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// deterministic pattern with long runs (RLE packets) and noise (raw packets)
+static TGAImage pattern_image(int32_t w, int32_t h, uint8_t bpp) {
+    TGAImage image(w, h, bpp);
+    uint32_t seed = 2019;
+    for (int j = 0; j < h; ++j) {
+        for (int i = 0; i < w; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            bool noisy = (j / 8 + i / 16) % 2;
+            auto v = static_cast<uint8_t>(noisy ? seed >> 24 : (i / 16 * 37 + j) & 0xff);
+            image.set(i, j, TGAColor(v, static_cast<uint8_t>(v ^ 0x5a), static_cast<uint8_t>(255 - v),
+                                     static_cast<uint8_t>(v | 1)));
+        }
+    }
+    return image;
+}
+
+static void write_obj(const std::string &filename, const std::vector<Vec3f> &vertices, const std::vector<Vec3i> &faces) {
+    std::ofstream out(filename);
+    for (const Vec3f &v : vertices) {
+        out << "v " << v.x << ' ' << v.y << ' ' << v.z << '\n';
+        out << "vt " << std::min(.999f, std::max(0.f, (v.x + 1) / 2)) << ' '
+            << std::min(.999f, std::max(0.f, (v.y + 1) / 2)) << " 0\n";
+    }
+    out << "vn 0 0 1\n";
+    for (const Vec3i &f : faces) {
+        out << "f " << f.x + 1 << '/' << f.x + 1 << "/1 " << f.y + 1 << '/' << f.y + 1 << "/1 " << f.z + 1 << '/'
+            << f.z + 1 << "/1\n";
+    }
+}
+
+// small synthetic scenes covering the raster corner cases, each with a procedural diffuse texture
+static std::vector<Scene> write_synthetic_scenes(const std::string &dir) {
+    std::vector<Scene> scenes;
+    TGAImage texture = pattern_image(256, 256, TGAImage::RGB);
+
+    // two overlapping quads at different depths and a triangle cutting through both
+    std::vector<Vec3f> v = {{-.8f, -.8f, 0}, {.4f, -.8f, 0}, {.4f, .4f, 0}, {-.8f, .4f, 0},
+                            {-.4f, -.4f, .3f}, {.8f, -.4f, .3f}, {.8f, .8f, .3f}, {-.4f, .8f, .3f},
+                            {-.9f, 0, -.5f}, {.9f, -.1f, .6f}, {0, .9f, .2f}};
+    std::vector<Vec3i> f = {{0, 1, 2}, {0, 2, 3}, {4, 5, 6}, {4, 6, 7}, {8, 9, 10}};
+    scenes.push_back({"overlap", dir + "/overlap.obj"});
+    write_obj(scenes.back().objFile, v, f);
+
+    // a triangle reaching far outside the viewport
+    v = {{-5, -5, 0}, {5, -4, .2f}, {0, 6, -.2f}};
+    f = {{0, 1, 2}};
+    scenes.push_back({"offscreen", dir + "/offscreen.obj"});
+    write_obj(scenes.back().objFile, v, f);
+
+    // a fan of sliver triangles
+    v = {{0, 0, 0}};
+    f.clear();
+    for (int i = 0; i < 64; ++i) {
+        float a = float(i) / 64 * 2 * float(M_PI);
+        v.emplace_back(std::cos(a), std::sin(a), .1f * std::sin(3 * a));
+        v.emplace_back(std::cos(a + .01f), std::sin(a + .01f), .1f * std::sin(3 * a));
+        f.emplace_back(0, 2 * i + 1, 2 * i + 2);
+    }
+    scenes.push_back({"slivers", dir + "/slivers.obj"});
+    write_obj(scenes.back().objFile, v, f);
+
+    for (const Scene &scene : scenes)
+        texture.write_tga_file(scene.objFile.substr(0, scene.objFile.size() - 4) + "_diffuse.tga");
+    return scenes;
+}
+
+static int round_trip_tga(const std::string &dir) {
+    int failures = 0;
+    const uint8_t formats[3] = {TGAImage::GRAYSCALE, TGAImage::RGB, TGAImage::RGBA};
+    for (uint8_t bpp : formats) {
+        for (int rle = 0; rle < 2; ++rle) {
+            TGAImage original = pattern_image(173, 91, bpp);
+            std::string file = dir + "/roundtrip.tga";
+            TGAImage loaded;
+            bool is_ok = original.write_tga_file(file, rle != 0) && loaded.read_tga_file(file);
+            ImageDiff diff = compare_images(original, loaded, 0);
+            is_ok = is_ok && diff.sameShape && !diff.differingPixels;
+            std::cerr << "# verify tga round trip " << bpp * 8 << " bpp" << (rle ? " rle" : " raw") << ": "
+                      << (is_ok ? "ok" : "FAIL") << std::endl;
+            failures += !is_ok;
+            remove(file.c_str());
+        }
+    }
+    return failures;
+}
+
+static int check_image(const std::string &file, const TGAImage &image, const VerifyOptions &options) {
+    if (options.update)
+        return image.write_tga_file(file) ? 0 : 1;
+
+    TGAImage golden;
+    if (!golden.read_tga_file(file)) {
+        std::cerr << "# verify " << file << ": FAIL (no golden image, run with --update-golden)" << std::endl;
+        return 1;
+    }
+    ImageDiff diff = compare_images(image, golden, options.tolerance);
+    bool is_ok = diff.sameShape && !diff.differingPixels;
+    std::cerr << "# verify " << file << ": " << (is_ok ? "ok" : "FAIL") << " (max difference "
+              << diff.maxDifference << ", " << diff.differingPixels << " pixels over tolerance)" << std::endl;
+    return is_ok ? 0 : 1;
+}
+
+// renders the scene a few times, checks the last images and records the median time of every stage
+static int verify_scene(const Scene &scene, const VerifyOptions &options, const std::string &scratchDir,
+                        std::map<std::string, double> &timings) {
+    const int runs = 5;
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), options.width, options.height);
+
+    auto start = std::chrono::steady_clock::now();
+    Model model(scene.objFile.c_str());
+    timings[scene.name + ".load"] = seconds_since(start);
+
+    Framebuffer framebuffer(options.width, options.height, TGAImage::RGB, options.layout);
+    TGAImage zBufImage(options.width, options.height, TGAImage::GRAYSCALE);
+    FrameArena arena;
+    std::vector<double> rendering, flipping, encoding;
+    std::string scratch = scratchDir + "/encode.tga";
+
+    for (int run = 0; run < runs; ++run) {
+        framebuffer.clear();
+        arena.reset();
+        start = std::chrono::steady_clock::now();
+        render(&model, transformMatrix, lightDirection, framebuffer, arena);
+        rendering.push_back(seconds_since(start));
+
+        framebuffer.resolve();
+        start = std::chrono::steady_clock::now();
+        framebuffer.color.flip_vertically();
+        flipping.push_back(seconds_since(start));
+
+        start = std::chrono::steady_clock::now();
+        framebuffer.color.write_tga_file(scratch);
+        encoding.push_back(seconds_since(start));
+    }
+    remove(scratch.c_str());
+    timings[scene.name + ".render"] = median(rendering);
+    timings[scene.name + ".flip"] = median(flipping);
+    timings[scene.name + ".encode"] = median(encoding);
+
+    framebuffer.depth_image(zBufImage);
+    zBufImage.flip_vertically();
+    return check_image(options.goldenDir + "/" + scene.name + "_output.tga", framebuffer.color, options) +
+           check_image(options.goldenDir + "/" + scene.name + "_zBuffer.tga", zBufImage, options);
+}
+
+static int write_budgets(const std::string &budgetFile, const std::map<std::string, double> &timings) {
+    std::ofstream out(budgetFile);
+    out << "# stage budgets in seconds, measured on this machine\n";
+    for (const auto &timing : timings)
+        out << timing.first << ' ' << timing.second << '\n';
+    return out.good() ? 0 : 1;
+}
+
+static int check_budgets(const std::map<std::string, double> &timings, const VerifyOptions &options) {
+    std::string budgetFile = options.goldenDir + "/budget.txt";
+    if (options.update)
+        return write_budgets(budgetFile, timings);
+    if (!options.checkBudgets) {
+        std::cerr << "# verify budgets: skipped (--no-budgets)" << std::endl;
+        return 0;
+    }
+
+    std::ifstream in(budgetFile);
+    if (!in.is_open()) {
+        if (options.recordBudgets) {
+            std::cerr << "# verify budgets: recorded in " << budgetFile << std::endl;
+            return write_budgets(budgetFile, timings);
+        }
+        std::cerr << "# verify budgets: FAIL (no " << budgetFile << ", run with --record-budgets or --no-budgets)"
+                  << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream iss(line);
+        std::string stage;
+        double budget;
+        if (!(iss >> stage >> budget))
+            continue;
+        auto timing = timings.find(stage);
+        if (timing == timings.end())
+            continue;
+
+        // tiny stages are dominated by timer noise, give them an absolute margin as well
+        double limit = budget * (1 + options.budgetSlack) + 1e-3;
+        bool is_ok = timing->second <= limit;
+        std::cerr << "# verify budget " << stage << ": " << (is_ok ? "ok" : "FAIL") << " (" << timing->second
+                  << "s, budget " << budget << "s)" << std::endl;
+        failures += !is_ok;
+    }
+    return failures;
+}
+
+// A grid filling the view, zoomed in so far that its outer triangles land more than 32767 pixels off the screen
+// while the instance still passes culling. Every pixel of the view must be drawn.
+static int check_zoomed_instance(const std::string &dir, const VerifyOptions &options) {
+    const int cells = 16;
+    std::vector<Vec3f> v;
+    std::vector<Vec3i> f;
+    for (int j = 0; j <= cells; ++j)
+        for (int i = 0; i <= cells; ++i)
+            v.emplace_back(2.f * i / cells - 1, 2.f * j / cells - 1, 0);
+    for (int j = 0; j < cells; ++j) {
+        for (int i = 0; i < cells; ++i) {
+            int corner = j * (cells + 1) + i;
+            f.emplace_back(corner, corner + 1, corner + cells + 2);
+            f.emplace_back(corner, corner + cells + 2, corner + cells + 1);
+        }
+    }
+    std::string objFile = dir + "/zoomed.obj";
+    std::string textureFile = dir + "/zoomed_diffuse.tga";
+    write_obj(objFile, v, f);
+    pattern_image(256, 256, TGAImage::RGB).write_tga_file(textureFile);
+    Model model(objFile.c_str());
+    remove(objFile.c_str());
+    remove(textureFile.c_str());
+
+    // scales screen x and y about the center of the view
+    const float zoom = 128;
+    Matrix zoomMatrix = Matrix::identity();
+    zoomMatrix[0][0] = zoomMatrix[1][1] = zoom;
+    zoomMatrix[0][3] = -(zoom - 1) * options.width / 2;
+    zoomMatrix[1][3] = -(zoom - 1) * options.height / 2;
+    Matrix transformMatrix = zoomMatrix * camera_transform(Vec3f(0, 0, 3), Vec3f(0, 0, 0), options.width,
+                                                           options.height);
+
+    Framebuffer framebuffer(options.width, options.height, TGAImage::RGB, options.layout);
+    framebuffer.clear();
+    InstancedRenderer renderer(&model);
+    std::vector<Instance> instances = {make_instance(Vec3f(0, 0, 0), 0, 1, Vec3f(1, 1, 1))};
+    InstancedRenderer::Stats stats = renderer.render(instances, transformMatrix, Vec3f(0, 0, 1), framebuffer);
+
+    long covered = 0;
+    for (int y = 0; y < options.height; ++y)
+        for (int x = 0; x < options.width; ++x)
+            covered += framebuffer.zBuffer[framebuffer.pixel_index(x, y)] != std::numeric_limits<int>::min();
+    bool is_ok = stats.drawn == 1 && covered == static_cast<long>(options.width) * options.height;
+    std::cerr << "# verify zoomed instance: " << (is_ok ? "ok" : "FAIL") << " (" << covered << " pixels covered, "
+              << stats.fragments << " fragments)" << std::endl;
+    return is_ok ? 0 : 1;
+}
+
+// A retained editing session: moves (one of them behind the camera and back), light changes and both at once. After
+// every update the cached frame must equal a redraw of the scene from scratch, pixel for pixel and in depth.
+static int check_retained_scene(const Scene &scene, const VerifyOptions &options) {
+    Model model(scene.objFile.c_str());
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), options.width, options.height);
+    RetainedScene retained(transformMatrix, options.width, options.height);
+    std::vector<Instance> placements;
+    instance_grid(model, 16, 1.2f, placements);
+    for (const Instance &placement : placements)
+        retained.add_object(&model, placement);
+    retained.set_light(Vec3f(1, 0, 3).normalize());
+    retained.update();
+
+    Instance shifted = retained.get_placement(5);
+    shifted.transform[0][3] += .3f;
+    shifted.transform[1][3] -= .2f;
+    const Instance behind = make_instance(Vec3f(2, 0, 7), 0, 1, Vec3f(1, 1, 1));
+    const Instance returned = make_instance(Vec3f(-.3f, .2f, .4f), 30, .5f, Vec3f(1, .5f, .5f));
+    const int steps = 5;
+    int failures = 0;
+    for (int step = 0; step < steps; ++step) {
+        if (step == 0)
+            retained.move_object(5, shifted);
+        if (step == 1)
+            retained.move_object(9, behind);
+        if (step == 2)
+            retained.set_light(Vec3f(-1, 1, 2).normalize());
+        if (step == 3)
+            retained.move_object(9, returned);
+        if (step == 4) {
+            retained.move_object(0, shifted);
+            retained.set_light(Vec3f(0, -1, 1).normalize());
+        }
+        retained.update();
+
+        RetainedScene redraw(transformMatrix, options.width, options.height);
+        for (int id = 0; id < retained.size(); ++id)
+            redraw.add_object(&model, retained.get_placement(id));
+        redraw.set_light(retained.get_light());
+        redraw.update();
+        ImageDiff diff = compare_images(retained.get_framebuffer().color, redraw.get_framebuffer().color, 0);
+        bool sameDepth = retained.get_framebuffer().zBuffer == redraw.get_framebuffer().zBuffer;
+        failures += diff.differingPixels || !sameDepth;
+        if (diff.differingPixels || !sameDepth)
+            std::cerr << "# verify retained step " << step << ": " << diff.differingPixels << " pixels differ, depth "
+                      << (sameDepth ? "identical" : "DIFFERS") << std::endl;
+    }
+    std::cerr << "# verify retained scene: " << (failures ? "FAIL" : "ok") << " (" << steps
+              << " updates against a redraw from scratch)" << std::endl;
+    return failures ? 1 : 0;
+}
+
+// feeds the controller frames of a synthetic cost, fixedSeconds plus areaSeconds[lod] times the rendered area
+static void drive_budget(FrameBudget &budget, int frames, double fixedSeconds, const std::vector<double> &areaSeconds) {
+    for (int i = 0; i < frames; ++i) {
+        double scale = budget.get_scale();
+        budget.frame_done(fixedSeconds + areaSeconds[budget.get_lod()] * scale * scale, fixedSeconds);
+    }
+}
+
+static int report_budget(const char *name, bool is_ok, const FrameBudget &budget) {
+    const FrameBudget::Frame &last = budget.get_history().back();
+    std::cerr << "# verify frame budget " << name << ": " << (is_ok ? "ok" : "FAIL") << " (scale " << last.scale
+              << ", lod " << last.lod << ", " << budget.get_misses() << " misses)" << std::endl;
+    return is_ok ? 0 : 1;
+}
+
+// FrameBudget on synthetic timings: it settles below the headroom, reacts to a miss on the next frame, keeps the
+// scale when the cost moves by less than the minimum change, and goes to a coarser LOD and back
+static int check_frame_budget() {
+    int failures = 0;
+    const double seconds = .01, fixedSeconds = .001, headroom = .85;
+    const float step = 1.f / 32;
+
+    // from full scale at 31 ms to the largest scale within 85% of the 10 ms, then steady
+    FrameBudget budget(seconds);
+    drive_budget(budget, 30, fixedSeconds, {.03});
+    const std::vector<FrameBudget::Frame> &history = budget.get_history();
+    const float ideal = static_cast<float>(std::sqrt((headroom * seconds - fixedSeconds) / .03));
+    bool is_ok = !history[0].hit && history[1].hit && budget.get_scale() <= ideal &&
+                 budget.get_scale() > ideal - step;
+    for (size_t i = 1; i < history.size(); ++i)
+        is_ok = is_ok && history[i].scale == history[1].scale && history[i].seconds <= headroom * seconds + 1e-12;
+    failures += report_budget("converges", is_ok, budget);
+
+    // twice the cost: the miss lowers the scale of the very next frame, which fits again
+    const float settled = budget.get_scale();
+    const size_t before = history.size();
+    drive_budget(budget, 10, fixedSeconds, {.06});
+    is_ok = !history[before].hit && history[before + 1].scale < settled && history[before + 1].hit;
+    failures += report_budget("miss", is_ok, budget);
+
+    // a little cheaper: the ideal scale grows by less than 1/16, the resolution stays
+    FrameBudget steady(seconds);
+    drive_budget(steady, 10, fixedSeconds, {.03});
+    const float steadyScale = steady.get_scale();
+    const int steadyMisses = steady.get_misses();
+    drive_budget(steady, 20, fixedSeconds, {.025});
+    is_ok = static_cast<float>(std::sqrt((headroom * seconds - fixedSeconds) / .025)) - steadyScale > step &&
+            steady.get_scale() == steadyScale && steady.get_misses() == steadyMisses;
+    failures += report_budget("small change", is_ok, steady);
+
+    // too slow even at the smallest scale: LOD 1, which fits; once the model gets cheap, back to LOD 0
+    FrameBudget lods(seconds, .25f, 2);
+    drive_budget(lods, 20, fixedSeconds, {.4, .1, .05});
+    bool coarser = lods.get_lod() == 1 && lods.get_history().back().hit;
+    drive_budget(lods, 20, fixedSeconds, {.005, .002, .001});
+    is_ok = coarser && lods.get_lod() == 0 && lods.get_scale() == 1 && lods.get_history().back().hit;
+    for (const FrameBudget::Frame &frame : lods.get_history())
+        is_ok = is_ok && frame.lod <= 1;
+    failures += report_budget("lod", is_ok, lods);
+    return failures;
+}
+
+int run_verify(const VerifyOptions &options) {
+    char scratchTemplate[] = "/tmp/ssr-verify-XXXXXX";
+    if (!mkdtemp(scratchTemplate)) {
+        std::cerr << "Can't create a scratch directory\n";
+        return 1;
+    }
+    std::string scratchDir = scratchTemplate;
+
+    int failures = round_trip_tga(scratchDir);
+
+    std::vector<Scene> scenes = {{"head", options.modelFile}};
+    std::vector<Scene> synthetic = write_synthetic_scenes(scratchDir);
+    // without a diffuse map of its own the model would render black, a copy gets the procedural texture
+    std::string modelBase = options.modelFile.substr(0, options.modelFile.rfind('.'));
+    if (!std::ifstream(modelBase + "_diffuse.tga").good()) {
+        Scene copy{"head", scratchDir + "/head.obj"};
+        std::ifstream in(options.modelFile);
+        std::ofstream out(copy.objFile);
+        out << in.rdbuf();
+        pattern_image(256, 256, TGAImage::RGB).write_tga_file(scratchDir + "/head_diffuse.tga");
+        scenes[0] = copy;
+    }
+    scenes.insert(scenes.end(), synthetic.begin(), synthetic.end());
+
+    std::map<std::string, double> timings;
+    for (const Scene &scene : scenes)
+        failures += verify_scene(scene, options, scratchDir, timings);
+    failures += check_budgets(timings, options);
+    if (!options.update) {
+        failures += check_zoomed_instance(scratchDir, options);
+        failures += check_retained_scene(scenes[0], options);
+        failures += check_frame_budget();
+    }
+
+    if (scenes[0].objFile != options.modelFile)
+        synthetic.push_back(scenes[0]);
+    for (const Scene &scene : synthetic) {
+        remove(scene.objFile.c_str());
+        remove((scene.objFile.substr(0, scene.objFile.size() - 4) + "_diffuse.tga").c_str());
+    }
+    rmdir(scratchDir.c_str());
+
+    std::cerr << "# verify " << (options.update ? "updated " + options.goldenDir : failures ? "FAILED" : "passed")
+              << std::endl;
+    return failures;
+}
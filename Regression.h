@@ -0,0 +1,40 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_REGRESSION_H
+#define SIMPLESOFTWARERENDERER_REGRESSION_H
+
+#include <string>
+#include "Framebuffer.h"
+#include "TGAImage.h"
+
+struct ImageDiff {
+    bool sameShape;          // width, height and bytes per pixel match
+    int maxDifference;       // largest per-channel difference
+    long differingPixels;    // pixels with any channel differing by more than the tolerance
+};
+
+ImageDiff compare_images(const TGAImage &a, const TGAImage &b, int tolerance);
+
+struct VerifyOptions {
+    std::string goldenDir;
+    std::string modelFile;
+    bool update;            // store the current images and timings as the new reference
+    bool recordBudgets;     // store the current timings as the budgets when there are none yet
+    bool checkBudgets;      // false skips the timing check, otherwise missing budgets fail it
+    int tolerance;          // per-channel difference accepted against the golden images
+    double budgetSlack;     // a stage fails when it is slower than budget * (1 + slack)
+    int32_t width, height;
+    Framebuffer::Layout layout;
+};
+
+// Regression check of the renderer. Renders the model and a set of synthetic scenes and compares
+// output.tga and zBuffer.tga against golden images in goldenDir, round-trips read_tga_file/write_tga_file
+// in every format with and without RLE, draws an instance reaching far outside the view with
+// InstancedRenderer, edits a RetainedScene against redraws from scratch, drives FrameBudget with synthetic
+// timings, and checks the median time of each stage against the per-machine budget stored next to the
+// golden images. Returns the number of failed checks.
+int run_verify(const VerifyOptions &options);
+
+#endif //SIMPLESOFTWARERENDERER_REGRESSION_H
@@ -0,0 +1,320 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include "AllocStats.h"
+#include "Renderer.h"
+#include "Shading.h"
+#include "Trace.h"
+
+static const int depth = 255;
+
+bool clip_line(Vec2f &p0, Vec2f &p1, float xMax, float yMax, float &t0, float &t1) {
+    // Liang-Barsky: the segment is p0 + t * d, every window edge trims the [t0, t1] range
+    float dx = p1.x - p0.x;
+    float dy = p1.y - p0.y;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {p0.x, xMax - p0.x, p0.y, yMax - p0.y};
+    t0 = 0.f;
+    t1 = 1.f;
+
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.f) {
+            if (q[i] < 0.f)
+                return false;
+            continue;
+        }
+        float t = q[i] / p[i];
+        if (p[i] < 0.f) {
+            if (t > t1)
+                return false;
+            t0 = std::max(t0, t);
+        } else {
+            if (t < t0)
+                return false;
+            t1 = std::min(t1, t);
+        }
+    }
+
+    Vec2f d(dx, dy);
+    p1 = p0 + d * t1;
+    p0 = p0 + d * t0;
+    return true;
+}
+
+// Bresenham over already clipped endpoints; plot(x, y, step, steps) for every pixel
+template<class Plot>
+static void bresenham(int x0, int y0, int x1, int y1, Plot plot) {
+    bool steep = false;
+    if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+        steep = true;
+    }
+
+    if (x0 > x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    int dx = x1 - x0;
+    int dy = y1 - y0;
+    int derror = std::abs(dy) * 2;
+    int error = 0;
+    int y = y0;
+
+    for (int x = x0; x <= x1; x++) {
+        if (steep)
+            plot(y, x, x - x0, dx);
+        else
+            plot(x, y, x - x0, dx);
+        error += derror;
+
+        if (error > dx) {
+            y += y1 > y0 ? 1 : -1;
+            error -= dx * 2;
+        }
+    }
+}
+
+void line(int x0, int y0, int x1, int y1, TGAImage &image, const TGAColor &color) {
+    int width = image.get_width();
+    int height = image.get_height();
+    if (!image.buffer() || width <= 0 || height <= 0)
+        return;
+
+    Vec2f p0(x0, y0), p1(x1, y1);
+    float t0, t1;
+    if (!clip_line(p0, p1, width - 1, height - 1, t0, t1))
+        return;
+
+    uint8_t *data = image.buffer();
+    const int bpp = image.get_bytesPerPixel();
+    bresenham(int(p0.x + .5f), int(p0.y + .5f), int(p1.x + .5f), int(p1.y + .5f),
+              [data, bpp, width, &color](int x, int y, int, int) {
+                  uint8_t *pixel = data + (x + y * width) * bpp;
+                  for (int t = 0; t < bpp; ++t)
+                      pixel[t] = color.bgra[t];
+              });
+}
+
+void line(int x0, int y0, int x1, int y1, Framebuffer &framebuffer, const TGAColor &color) {
+    int width = framebuffer.get_width();
+    int height = framebuffer.get_height();
+    if (width <= 0 || height <= 0)
+        return;
+
+    Vec2f p0(x0, y0), p1(x1, y1);
+    float t0, t1;
+    if (!clip_line(p0, p1, width - 1, height - 1, t0, t1))
+        return;
+
+    uint8_t *data = framebuffer.pixels();
+    const int bpp = framebuffer.color.get_bytesPerPixel();
+    bresenham(int(p0.x + .5f), int(p0.y + .5f), int(p1.x + .5f), int(p1.y + .5f),
+              [data, bpp, &framebuffer, &color](int x, int y, int, int) {
+                  uint8_t *pixel = data + framebuffer.pixel_index(x, y) * bpp;
+                  for (int t = 0; t < bpp; ++t)
+                      pixel[t] = color.bgra[t];
+              });
+}
+
+void line(const Vec3f &v0, const Vec3f &v1, Framebuffer &framebuffer, const TGAColor &color, int depthBias) {
+    int width = framebuffer.get_width();
+    int height = framebuffer.get_height();
+
+    Vec2f p0(v0.x, v0.y), p1(v1.x, v1.y);
+    float t0, t1;
+    if (!clip_line(p0, p1, width - 1, height - 1, t0, t1))
+        return;
+
+    float z0 = v0.z + (v1.z - v0.z) * t0;
+    float z1 = v0.z + (v1.z - v0.z) * t1;
+    int ix0 = int(p0.x + .5f), iy0 = int(p0.y + .5f);
+    int ix1 = int(p1.x + .5f), iy1 = int(p1.y + .5f);
+    // bresenham() walks from the endpoint with the smaller major coordinate
+    bool reversed = std::abs(ix0 - ix1) < std::abs(iy0 - iy1) ? iy0 > iy1 : ix0 > ix1;
+    if (reversed)
+        std::swap(z0, z1);
+
+    uint8_t *data = framebuffer.pixels();
+    int *zBuffer = framebuffer.zBuffer.data();
+    const int bpp = framebuffer.color.get_bytesPerPixel();
+    bresenham(ix0, iy0, ix1, iy1, [=, &framebuffer, &color](int x, int y, int step, int steps) {
+        size_t offset = framebuffer.pixel_index(x, y);
+        int z = int(z0 + (z1 - z0) * (steps ? float(step) / steps : 0.f) + .5f);
+        if (zBuffer[offset] > z + depthBias)
+            return;
+        uint8_t *pixel = data + offset * bpp;
+        for (int t = 0; t < bpp; ++t)
+            pixel[t] = color.bgra[t];
+    });
+}
+
+void line(const Vec2i &vec1, const Vec2i &vec2, TGAImage &image, const TGAColor &color) {
+    line(vec1.x, vec1.y, vec2.x, vec2.y, image, color);
+}
+
+static void flush_batch(FragmentBatch &batch, uint8_t *data, int bpp) {
+    Trace::Span span("shade batch", batch.n);
+    batch.flush(data, bpp);
+}
+
+int triangle(Vec3i t[], Vec2i uv[], float ity[], const TGAImage *diffuse, Framebuffer &framebuffer,
+             int *faceIds, int face) {
+    const int width = framebuffer.get_width();
+    const int height = framebuffer.get_height();
+    const int bpp = framebuffer.color.get_bytesPerPixel();
+    uint8_t *data = framebuffer.pixels();
+    int *zBuffer = framebuffer.zBuffer.data();
+    FragmentBatch batch;
+    batch.n = 0;
+    int fragments = 0;
+
+    if (t[0].y == t[1].y && t[0].y == t[2].y)
+        return 0;
+
+    if (t[0].y > t[1].y) {
+        std::swap(t[0], t[1]);
+        std::swap(uv[0], uv[1]);
+        std::swap(ity[0], ity[1]);
+    }
+    if (t[0].y > t[2].y) {
+        std::swap(t[0], t[2]);
+        std::swap(uv[0], uv[2]);
+        std::swap(ity[0], ity[2]);
+    }
+    if (t[1].y > t[2].y) {
+        std::swap(t[1], t[2]);
+        std::swap(uv[1], uv[2]);
+        std::swap(ity[1], ity[2]);
+    }
+
+    int total_height = t[2].y - t[0].y;
+    for (int i = 0; i < total_height; i++) {
+        bool isSecondHalf = i > t[1].y - t[0].y || t[1].y == t[0].y;
+        int segment_height = isSecondHalf ? t[2].y - t[1].y : t[1].y - t[0].y;
+
+        float alpha = float(i) / total_height;
+        float beta = float(i - (isSecondHalf ? t[1].y - t[0].y : 0)) / segment_height;
+
+        Vec3i A = t[0] + Vec3f(t[2] - t[0]) * alpha;
+        Vec3i B = isSecondHalf ? t[1] + Vec3f(t[2] - t[1]) * beta : t[0] + Vec3f(t[1] - t[0]) * beta;
+
+        Vec2i uvA = uv[0] + (uv[2] - uv[0]) * alpha;
+        Vec2i uvB = isSecondHalf ? uv[1] + (uv[2] - uv[1]) * beta : uv[0] + (uv[1] - uv[0]) * beta;
+
+        float ityA = ity[0] + (ity[2] - ity[0]) * alpha;
+        float ityB = isSecondHalf ? ity[1] + (ity[2] - ity[1]) * beta : ity[0] + (ity[1] - ity[0]) * beta;
+
+        if (A.x > B.x) {
+            std::swap(A, B);
+            std::swap(uvA, uvB);
+            std::swap(ityA, ityB);
+        }
+
+        for (int x = A.x; x <= B.x; x++) {
+            float phi = A.x == B.x ? 1.f : float(x - A.x) / (B.x - A.x);
+
+            Vec3i P = Vec3f(A) + Vec3f(B - A) * phi;
+            Vec2i uvP = uvA + (uvB - uvA) * phi;
+            float ityP = ityA + (ityB - ityA) * phi;
+
+            if (P.x < 0 || P.y < 0 || P.x >= width || P.y >= height)
+                continue;
+
+            size_t idx = framebuffer.pixel_index(P.x, P.y);
+            fragments++;
+            if (zBuffer[idx] < P.z) {
+                zBuffer[idx] = P.z;
+                if (faceIds)
+                    faceIds[idx] = face;
+                batch.offsets[batch.n] = idx;
+                batch.texels[batch.n] = fetch_texel(diffuse, uvP.x, uvP.y);
+                batch.intensities[batch.n] = ityP;
+                if (++batch.n == FragmentBatch::size)
+                    flush_batch(batch, data, bpp);
+            }
+        }
+    }
+    flush_batch(batch, data, bpp);
+    return fragments;
+}
+
+Matrix getViewport(int x, int y, int w, int h) {
+    Matrix m = Matrix::identity(4);
+    m[0][3] = x + w / 2.f;
+    m[1][3] = y + h / 2.f;
+    m[2][3] = depth / 2.f;
+
+    m[0][0] = w / 2.f;
+    m[1][1] = h / 2.f;
+    m[2][2] = depth / 2.f;
+    return m;
+}
+
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
+    Vec3f z = (eye - center).normalize();
+    Vec3f x = (up ^ z).normalize();
+    Vec3f y = (z ^ x).normalize();
+    Matrix res = Matrix::identity();
+    for (int i = 0; i < 3; ++i) {
+        res[0][i] = x[i];
+        res[1][i] = y[i];
+        res[2][i] = z[i];
+        res[i][3] = -center[i];
+    }
+    return res;
+}
+
+Matrix camera_transform(const Vec3f &eye, const Vec3f &center, int width, int height) {
+    Matrix modelView = lookat(eye, center, Vec3f(0, 1, 0));
+    Matrix projection = Matrix::identity();
+    projection[3][2] = -1.f / (eye - center).z;
+    Matrix viewport = getViewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    return viewport * projection * modelView;
+}
+
+long long render(Model *model, Matrix &transformMatrix, const Vec3f &lightDirection, Framebuffer &framebuffer,
+            FrameArena &arena, int beginFace, int endFace) {
+    if (endFace < 0)
+        endFace = model->nFaces();
+
+    // shared vertices are transformed and shared normals lit once per frame instead of once per corner
+    Vec3f *screen;
+    float *intensities;
+    {
+        AllocStats::Scope stage(AllocStats::VERTEX);
+        Trace::Span span("vertex", model->nVertices());
+        screen = arena.allocate<Vec3f>(static_cast<size_t>(model->nVertices()));
+        model->decode_vertices(screen);
+        for (int i = 0; i < model->nVertices(); ++i)
+            screen[i] = transformMatrix.transform(screen[i]);
+
+        Vec3f *normals = arena.allocate<Vec3f>(static_cast<size_t>(model->nNormals()));
+        intensities = arena.allocate<float>(static_cast<size_t>(model->nNormals()));
+        model->decode_normals(normals);
+        for (int i = 0; i < model->nNormals(); ++i)
+            intensities[i] = normals[i] * lightDirection;
+    }
+
+    AllocStats::Scope stage(AllocStats::RASTER);
+    Trace::Span span("raster", endFace - beginFace);
+    long long fragments = 0;
+    for (int iFace = beginFace; iFace < endFace; ++iFace) {
+        Vec3i screen_c[3];
+        Vec2i uv[3];
+        float intensity[3];
+
+        for (int jVertex = 0; jVertex < 3; ++jVertex) {
+            Vec3i corner = model->corner(iFace, jVertex);
+            screen_c[jVertex] = screen[corner.x];
+            intensity[jVertex] = intensities[corner.z];
+            uv[jVertex] = model->get_uv(iFace, jVertex);
+        }
+
+        fragments += triangle(screen_c, uv, intensity, model->get_diffuse_map(), framebuffer);
+    }
+    return fragments;
+}
@@ -0,0 +1,49 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_RENDERER_H
+#define SIMPLESOFTWARERENDERER_RENDERER_H
+
+#include "Arena.h"
+#include "Framebuffer.h"
+#include "Model.h"
+#include "TGAImage.h"
+#include "geometry.h"
+
+// Liang-Barsky clipping of the segment p0-p1 against [0, xMax] x [0, yMax].
+// Returns false if nothing is left, otherwise moves the endpoints and sets the parameters of the kept part.
+bool clip_line(Vec2f &p0, Vec2f &p1, float xMax, float yMax, float &t0, float &t1);
+
+// lines are clipped to the image first and then written straight into its buffer
+void line(int x0, int y0, int x1, int y1, TGAImage &image, const TGAColor &color);
+
+void line(const Vec2i &vec1, const Vec2i &vec2, TGAImage &image, const TGAColor &color);
+
+// the same into the framebuffer color, in its layout
+void line(int x0, int y0, int x1, int y1, Framebuffer &framebuffer, const TGAColor &color);
+
+// depth-tested line in screen space: pixels hidden by more than depthBias in the z-buffer are skipped
+void line(const Vec3f &v0, const Vec3f &v1, Framebuffer &framebuffer, const TGAColor &color, int depthBias = 1);
+
+// fills the triangle with the diffuse texture modulated by the interpolated intensity (black without a texture),
+// pixels outside the image are skipped. Shading runs in batches through shade_fragments().
+// Returns the number of fragments that reached the depth test. With faceIds (pixel_count() entries) every pixel
+// the triangle wins is tagged with face.
+int triangle(Vec3i t[], Vec2i uv[], float ity[], const TGAImage *diffuse, Framebuffer &framebuffer,
+             int *faceIds = nullptr, int face = 0);
+
+Matrix getViewport(int x, int y, int w, int h);
+
+Matrix lookat(Vec3f eye, Vec3f center, Vec3f up);
+
+// viewport * projection * modelView of the default camera: looking at center from eye, drawn into the middle
+// three quarters of a width x height image
+Matrix camera_transform(const Vec3f &eye, const Vec3f &center, int width, int height);
+
+// draws the faces [beginFace, endFace) of the model into the framebuffer (all of them by default),
+// per-frame scratch comes from the arena. Returns the number of depth-tested fragments.
+long long render(Model *model, Matrix &transformMatrix, const Vec3f &lightDirection, Framebuffer &framebuffer,
+            FrameArena &arena, int beginFace = 0, int endFace = -1);
+
+#endif //SIMPLESOFTWARERENDERER_RENDERER_H
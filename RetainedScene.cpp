@@ -0,0 +1,318 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "RetainedScene.h"
+#include "Shading.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+RetainedScene::RetainedScene(Matrix &transformMatrix, int32_t w, int32_t h)
+        : width(w), height(h), tilesX((w + tileSize - 1) / tileSize), tilesY((h + tileSize - 1) / tileSize),
+          camera(), cache(w, h), albedo(), normals(), covered(), dirty(), changedRows(), objects(),
+          light(0, 0, 1), lightChanged(false) {
+    size_t nPixels = static_cast<size_t>(w) * h;
+    albedo.resize(nPixels);
+    normals.resize(nPixels);
+    covered.resize(nPixels);
+    changedRows.resize(static_cast<size_t>(h));
+    dirty.resize(static_cast<size_t>(tilesX) * tilesY);
+    set_camera(transformMatrix);
+}
+
+int RetainedScene::add_object(Model *model, const Instance &placement) {
+    Object object;
+    object.model = model;
+    object.placement = placement;
+    object.moved = true;
+    object.drawn = Bounds{0, 0, -1, -1};
+    object.bounds = object.drawn;
+    object.vertices.resize(static_cast<size_t>(model->nVertices()));
+    model->decode_vertices(object.vertices.data());
+    object.modelNormals.resize(static_cast<size_t>(model->nNormals()));
+    model->decode_normals(object.modelNormals.data());
+    bounding_sphere(object.vertices, object.sphereCenter, object.sphereRadius);
+    object.screen.resize(object.vertices.size());
+    object.normals.resize(object.modelNormals.size());
+    object.corners.resize(static_cast<size_t>(model->nFaces()) * 3);
+    object.texels.resize(object.corners.size());
+    for (int iFace = 0; iFace < model->nFaces(); ++iFace) {
+        for (int k = 0; k < 3; ++k) {
+            object.corners[iFace * 3 + k] = model->corner(iFace, k);
+            object.texels[iFace * 3 + k] = model->get_uv(iFace, k);
+        }
+    }
+    object.faceBounds.resize(static_cast<size_t>(model->nFaces()));
+    objects.push_back(std::move(object));
+    return static_cast<int>(objects.size()) - 1;
+}
+
+void RetainedScene::move_object(int id, const Instance &placement) {
+    objects[id].placement = placement;
+    objects[id].moved = true;
+}
+
+const Instance &RetainedScene::get_placement(int id) const {
+    return objects[id].placement;
+}
+
+int RetainedScene::size() const {
+    return static_cast<int>(objects.size());
+}
+
+void RetainedScene::set_light(const Vec3f &direction) {
+    light = direction;
+    lightChanged = true;
+}
+
+const Vec3f &RetainedScene::get_light() const {
+    return light;
+}
+
+void RetainedScene::set_camera(Matrix &transformMatrix) {
+    for (int r = 0; r < 4; ++r)
+        for (int c = 0; c < 4; ++c)
+            camera[r][c] = transformMatrix[r][c];
+    for (Object &object : objects)
+        object.moved = true;
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+const Framebuffer &RetainedScene::get_framebuffer() const {
+    return cache;
+}
+
+void RetainedScene::place(Object &object) {
+    Bounds &all = object.bounds;
+    all = Bounds{width, height, -1, -1};
+    float m[4][4];
+    instance_matrix(camera, object.placement, m);
+    // culled: update() still clears the area it was drawn in
+    if (!sphere_in_view(m, object.sphereCenter, object.sphereRadius, width, height))
+        return;
+
+    for (size_t i = 0; i < object.vertices.size(); ++i) {
+        const Vec3f &v = object.vertices[i];
+        float p[4];
+        for (int k = 0; k < 4; ++k)
+            p[k] = m[k][0] * v.x + m[k][1] * v.y + m[k][2] * v.z + m[k][3];
+        object.screen[i] = Vec3f(p[0] / p[3], p[1] / p[3], p[2] / p[3]);
+    }
+    const float (*t)[4] = object.placement.transform;
+    for (size_t i = 0; i < object.modelNormals.size(); ++i) {
+        const Vec3f &n = object.modelNormals[i];
+        Vec3f world(t[0][0] * n.x + t[0][1] * n.y + t[0][2] * n.z, t[1][0] * n.x + t[1][1] * n.y + t[1][2] * n.z,
+                    t[2][0] * n.x + t[2][1] * n.y + t[2][2] * n.z);
+        object.normals[i] = world.norm() > 0 ? world.normalize() : world;
+    }
+    tint_factors(object.placement.tint, object.tint);
+
+    for (size_t iFace = 0; iFace < object.faceBounds.size(); ++iFace) {
+        const Vec3i &s0 = object.screen[object.corners[iFace * 3].x];
+        const Vec3i &s1 = object.screen[object.corners[iFace * 3 + 1].x];
+        const Vec3i &s2 = object.screen[object.corners[iFace * 3 + 2].x];
+        Bounds b{std::max(0, std::min(s0.x, std::min(s1.x, s2.x))),
+                 std::max(0, std::min(s0.y, std::min(s1.y, s2.y))),
+                 std::min(width - 1, std::max(s0.x, std::max(s1.x, s2.x))),
+                 std::min(height - 1, std::max(s0.y, std::max(s1.y, s2.y)))};
+        if (edge(s0, s1, s2.x, s2.y) == 0 || b.yMin > b.yMax)
+            b.xMax = b.xMin - 1;
+        object.faceBounds[iFace] = b;
+        if (b.xMin > b.xMax)
+            continue;
+        all.xMin = std::min(all.xMin, b.xMin);
+        all.yMin = std::min(all.yMin, b.yMin);
+        all.xMax = std::max(all.xMax, b.xMax);
+        all.yMax = std::max(all.yMax, b.yMax);
+    }
+    if (all.yMin > all.yMax)
+        all.xMax = all.xMin - 1;
+}
+
+void RetainedScene::mark(const Bounds &bounds) {
+    if (bounds.xMin > bounds.xMax)
+        return;
+    for (int ty = bounds.yMin / tileSize; ty <= bounds.yMax / tileSize; ++ty)
+        for (int tx = bounds.xMin / tileSize; tx <= bounds.xMax / tileSize; ++tx)
+            dirty[static_cast<size_t>(ty) * tilesX + tx] = 1;
+}
+
+void RetainedScene::shade(int y, int xBegin, int xEnd) {
+    const int bpp = cache.color.get_bytesPerPixel();
+    uint8_t *data = cache.pixels();
+    FragmentBatch batch;
+    batch.n = 0;
+    for (int x = xBegin; x < xEnd; ++x) {
+        size_t g = static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+        if (!covered[g])
+            continue;
+        batch.offsets[batch.n] = g;
+        batch.texels[batch.n] = albedo[g];
+        batch.intensities[batch.n] = normals[g] * light;
+        if (++batch.n == FragmentBatch::size)
+            batch.flush(data, bpp);
+    }
+    batch.flush(data, bpp);
+}
+
+long long RetainedScene::raster_row(int tileRow) {
+    const int y0 = tileRow * tileSize, y1 = std::min(height, y0 + tileSize) - 1;
+    const uint8_t *rowDirty = dirty.data() + static_cast<size_t>(tileRow) * tilesX;
+    const int bpp = cache.color.get_bytesPerPixel();
+    uint8_t *data = cache.pixels();
+    int *zBuffer = cache.zBuffer.data();
+
+    bool any = false;
+    for (int tx = 0; tx < tilesX; ++tx) {
+        if (!rowDirty[tx])
+            continue;
+        any = true;
+        const int x0 = tx * tileSize, x1 = std::min(width, x0 + tileSize);
+        for (int y = y0; y <= y1; ++y) {
+            size_t g = static_cast<size_t>(y) * width;
+            memset(data + (g + x0) * bpp, 0, static_cast<size_t>(x1 - x0) * bpp);
+            std::fill(zBuffer + g + x0, zBuffer + g + x1, std::numeric_limits<int>::min());
+            std::fill(covered.begin() + g + x0, covered.begin() + g + x1, 0);
+        }
+    }
+    if (!any)
+        return 0;
+
+    long long fragments = 0;
+    for (const Object &object : objects) {
+        const Bounds &ob = object.bounds;
+        if (ob.xMin > ob.xMax || ob.yMax < y0 || ob.yMin > y1)
+            continue;
+        bool reaches = false;
+        for (int tx = ob.xMin / tileSize; tx <= ob.xMax / tileSize; ++tx)
+            reaches = reaches || rowDirty[tx];
+        if (!reaches)
+            continue;
+
+        const TGAImage *diffuse = object.model->get_diffuse_map();
+        for (size_t iFace = 0; iFace < object.faceBounds.size(); ++iFace) {
+            const Bounds &b = object.faceBounds[iFace];
+            if (b.xMin > b.xMax || b.yMax < y0 || b.yMin > y1)
+                continue;
+            Vec3i t[3];
+            Vec3f n[3];
+            Vec2i uv[3];
+            for (int k = 0; k < 3; ++k) {
+                const Vec3i &corner = object.corners[iFace * 3 + k];
+                t[k] = object.screen[corner.x];
+                n[k] = object.normals[corner.z];
+                uv[k] = object.texels[iFace * 3 + k];
+            }
+            const float inverseArea = 1.f / edge(t[0], t[1], t[2].x, t[2].y);
+
+            for (int tx = b.xMin / tileSize; tx <= b.xMax / tileSize; ++tx) {
+                if (!rowDirty[tx])
+                    continue;
+                const int xMin = std::max(b.xMin, tx * tileSize);
+                const int xMax = std::min(b.xMax, tx * tileSize + tileSize - 1);
+                const int yMin = std::max(b.yMin, y0), yMax = std::min(b.yMax, y1);
+                for (int y = yMin; y <= yMax; ++y) {
+                    for (int x = xMin; x <= xMax; ++x) {
+                        float b0, b1, b2;
+                        barycentric(t, inverseArea, x, y, b0, b1, b2);
+                        if (b0 < 0 || b1 < 0 || b2 < 0)
+                            continue;
+                        fragments++;
+                        int z = static_cast<int>(b0 * t[0].z + b1 * t[1].z + b2 * t[2].z + .5f);
+                        size_t g = static_cast<size_t>(x) + static_cast<size_t>(y) * width;
+                        if (zBuffer[g] >= z)
+                            continue;
+                        zBuffer[g] = z;
+                        covered[g] = 1;
+                        // interpolating the normal and lighting per pixel is the Gouraud intensity, n . l is linear
+                        normals[g] = n[0] * b0 + n[1] * b1 + n[2] * b2;
+                        albedo[g] = tint_texel(interpolate_texel(diffuse, uv, b0, b1, b2), object.tint);
+                    }
+                }
+            }
+        }
+    }
+
+    // with a new light the whole frame is shaded afterwards
+    if (!lightChanged) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            if (!rowDirty[tx])
+                continue;
+            for (int y = y0; y <= y1; ++y)
+                shade(y, tx * tileSize, std::min(width, tx * tileSize + tileSize));
+        }
+    }
+    return fragments;
+}
+
+RetainedScene::Stats RetainedScene::update() {
+    Trace::Span span("retained update");
+    Stats stats{0, 0, lightChanged, 0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+
+    // an object that moved leaves its old area and covers its new one
+    for (Object &object : objects) {
+        if (!object.moved)
+            continue;
+        mark(object.drawn);
+        place(object);
+        mark(object.bounds);
+        object.drawn = object.bounds;
+        object.moved = false;
+    }
+
+    std::fill(changedRows.begin(), changedRows.end(), 0);
+    for (int ty = 0; ty < tilesY; ++ty) {
+        int rowTiles = static_cast<int>(std::count(dirty.begin() + ty * tilesX, dirty.begin() + (ty + 1) * tilesX, 1));
+        stats.dirtyTiles += rowTiles;
+        if (rowTiles)
+            std::fill(changedRows.begin() + ty * tileSize,
+                      changedRows.begin() + std::min(height, (ty + 1) * tileSize), 1);
+    }
+
+    ThreadPool &pool = ThreadPool::instance();
+    if (stats.dirtyTiles) {
+        std::atomic<long long> fragments(0);
+        pool.parallel_for(0, tilesY, 1, [&](int first, int last) {
+            for (int tileRow = first; tileRow < last; ++tileRow)
+                fragments += raster_row(tileRow);
+        });
+        stats.fragments = fragments;
+    }
+    auto drawn = std::chrono::steady_clock::now();
+    stats.drawSeconds = std::chrono::duration<double>(drawn - start).count();
+
+    if (lightChanged) {
+        Trace::Span reshadeSpan("reshade");
+        pool.parallel_for(0, height, 16, [&](int first, int last) {
+            for (int y = first; y < last; ++y)
+                shade(y, 0, width);
+        });
+        std::fill(changedRows.begin(), changedRows.end(), 1);
+        stats.reshadeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - drawn).count();
+    }
+
+    stats.changedRows = static_cast<int>(std::count(changedRows.begin(), changedRows.end(), 1));
+    std::fill(dirty.begin(), dirty.end(), 0);
+    lightChanged = false;
+    return stats;
+}
+
+bool RetainedScene::copy_to(Framebuffer &target) const {
+    if (target.get_width() != width || target.get_height() != height || target.get_layout() != Framebuffer::LINEAR ||
+        target.color.get_bytesPerPixel() != cache.color.get_bytesPerPixel()) {
+        std::cerr << "The retained frame goes to a linear framebuffer of the same size and format only\n";
+        return false;
+    }
+    const size_t bytes = static_cast<size_t>(width) * height * cache.color.get_bytesPerPixel();
+    memcpy(target.pixels(), cache.color.buffer(), bytes);
+    std::copy(cache.zBuffer.begin(), cache.zBuffer.end(), target.zBuffer.begin());
+    target.changedRows = changedRows;
+    return true;
+}
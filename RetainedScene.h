@@ -0,0 +1,107 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_RETAINEDSCENE_H
+#define SIMPLESOFTWARERENDERER_RETAINEDSCENE_H
+
+#include <vector>
+#include "Framebuffer.h"
+#include "Instancing.h"
+#include "Model.h"
+#include "geometry.h"
+
+// Scene kept between frames for editing, where only an object or the light changes from one frame to the next.
+// The frame is cached with its depth and a G-buffer (tinted texel and interpolated normal per pixel). Moving an
+// object marks the 32x32 tiles of its old and new screen bounds dirty; update() clears those tiles and draws every
+// object that reaches them again, clipped to them, in parallel over tile rows. A new light shades the cached
+// G-buffer again without rasterizing. Both paths shade the same way, so the cache is bit-identical to drawing the
+// whole scene from scratch. As in InstancedRenderer, objects reaching into the nearest 10% of the camera distance
+// are dropped rather than clipped.
+class RetainedScene {
+public:
+    static const int tileSize = 32;
+
+    struct Stats {
+        int dirtyTiles;
+        int changedRows;
+        bool reshaded;          // the light changed, every pixel was shaded again
+        long long fragments;
+        double drawSeconds;     // clearing, rasterizing and shading the dirty tiles
+        double reshadeSeconds;
+    };
+
+    RetainedScene(Matrix &transformMatrix, int32_t w, int32_t h);
+
+    // returns the id of the object
+    int add_object(Model *model, const Instance &placement);
+
+    void move_object(int id, const Instance &placement);
+
+    const Instance &get_placement(int id) const;
+
+    int size() const;
+
+    void set_light(const Vec3f &direction);
+
+    const Vec3f &get_light() const;
+
+    // a new camera makes the whole frame dirty
+    void set_camera(Matrix &transformMatrix);
+
+    // draws what changed since the last update
+    Stats update();
+
+    const Framebuffer &get_framebuffer() const;
+
+    // the frame into a linear framebuffer of the same size, with the rows the last update changed marked
+    bool copy_to(Framebuffer &target) const;
+
+private:
+    struct Bounds {
+        int xMin, yMin, xMax, yMax;     // empty when xMin > xMax
+    };
+
+    struct Object {
+        Model *model;
+        Instance placement;
+        bool moved;
+        Bounds drawn;                   // screen bounds in the cached frame
+        Bounds bounds;                  // screen bounds at the current placement
+        std::vector<Vec3f> vertices;
+        std::vector<Vec3f> modelNormals;
+        Vec3f sphereCenter;
+        float sphereRadius;
+        std::vector<Vec3i> screen;
+        std::vector<Vec3f> normals;     // world space
+        std::vector<Vec3i> corners;
+        std::vector<Vec2i> texels;
+        std::vector<Bounds> faceBounds;
+        uint16_t tint[4];
+    };
+
+    int32_t width, height;
+    int tilesX, tilesY;
+    float camera[4][4];
+    Framebuffer cache;
+    std::vector<uint32_t> albedo;
+    std::vector<Vec3f> normals;
+    std::vector<uint8_t> covered;
+    std::vector<uint8_t> dirty;         // per tile
+    std::vector<uint8_t> changedRows;
+    std::vector<Object> objects;
+    Vec3f light;
+    bool lightChanged;
+
+    // projects the object at its placement, empty bounds when it is culled
+    void place(Object &object);
+
+    void mark(const Bounds &bounds);
+
+    long long raster_row(int tileRow);
+
+    // shades the covered pixels of the row span from the G-buffer
+    void shade(int y, int xBegin, int xEnd);
+};
+
+#endif //SIMPLESOFTWARERENDERER_RETAINEDSCENE_H
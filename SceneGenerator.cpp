@@ -0,0 +1,239 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include "SceneGenerator.h"
+
+static const char *const sceneNames[N_SCENE_KINDS] = {"sphere", "slivers", "overdraw", "offscreen"};
+
+bool parse_scene(const std::string &text, SceneSpec &spec) {
+    size_t colon = text.find(':');
+    std::string name = text.substr(0, colon);
+    int kind = 0;
+    while (kind < N_SCENE_KINDS && name != sceneNames[kind])
+        kind++;
+    if (kind == N_SCENE_KINDS || colon == std::string::npos) {
+        std::cerr << "Unknown scene " << text << ", expected sphere|slivers|overdraw|offscreen:TRIANGLES\n";
+        return false;
+    }
+
+    char *end;
+    double count = std::strtod(text.c_str() + colon + 1, &end);
+    if (*end == 'K' || *end == 'k')
+        count *= 1e3;
+    else if (*end == 'M' || *end == 'm')
+        count *= 1e6;
+    if (count < 1 || count > 2e9) {
+        std::cerr << "Bad triangle count in " << text << '\n';
+        return false;
+    }
+    // slivers share no vertices, their indices must still fit in int
+    if (kind == SLIVERS && count > INT_MAX / 3) {
+        std::cerr << "At most " << INT_MAX / 3 << " slivers, their vertex indices overflow beyond\n";
+        return false;
+    }
+    spec.kind = static_cast<SceneKind>(kind);
+    spec.triangles = static_cast<long long>(count);
+    return true;
+}
+
+const char *scene_name(SceneKind kind) {
+    return sceneNames[kind];
+}
+
+static float random_unit(uint32_t &seed) {
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / float(1 << 24);
+}
+
+// uv of a point of the [-1, 1] square, kept below 1 so it stays inside the texture
+static Vec2f square_uv(float x, float y) {
+    return {std::min(.999f, std::max(0.f, (x + 1) / 2)), std::min(.999f, std::max(0.f, (y + 1) / 2))};
+}
+
+static long long sphere(long long triangles, MeshVisitor &visitor) {
+    const float radius = .8f;
+    int stacks = std::max(2, int(std::sqrt(double(triangles) / 4) + .5));
+    int slices = 2 * stacks;
+    for (int i = 0; i <= stacks; ++i) {
+        float theta = float(M_PI) * i / stacks;
+        for (int j = 0; j <= slices; ++j) {
+            float phi = 2 * float(M_PI) * j / slices;
+            Vec3f normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            Vec2f uv(std::min(.999f, float(j) / slices), std::min(.999f, 1.f - float(i) / stacks));
+            visitor.vertex(normal * radius, uv, normal);
+        }
+    }
+    for (int i = 0; i < stacks; ++i) {
+        for (int j = 0; j < slices; ++j) {
+            int a = i * (slices + 1) + j;
+            int b = a + slices + 1;
+            visitor.face(a, b, a + 1);
+            visitor.face(a + 1, b, b + 1);
+        }
+    }
+    return 2LL * stacks * slices;
+}
+
+static long long slivers(long long triangles, MeshVisitor &visitor) {
+    // three vertices of their own per sliver, indexed by int
+    triangles = std::min(triangles, static_cast<long long>(INT_MAX / 3));
+    const float length = .6f;
+    const float thickness = 1e-4f;
+    const Vec3f normal(0, 0, 1);
+    uint32_t seed = 35;
+    for (long long i = 0; i < triangles; ++i) {
+        Vec3f p(random_unit(seed) * 2 - 1, random_unit(seed) * 2 - 1, random_unit(seed) - .5f);
+        float angle = random_unit(seed) * 2 * float(M_PI);
+        Vec3f along(std::cos(angle) * length, std::sin(angle) * length, 0);
+        Vec3f across(-std::sin(angle) * thickness, std::cos(angle) * thickness, 0);
+        Vec3f q = p + along, r = p + along + across;
+        visitor.vertex(p, square_uv(p.x, p.y), normal);
+        visitor.vertex(q, square_uv(q.x, q.y), normal);
+        visitor.vertex(r, square_uv(r.x, r.y), normal);
+        int base = int(3 * i);
+        visitor.face(base, base + 1, base + 2);
+    }
+    return triangles;
+}
+
+// size x size quads of the square [-extent, extent] at depth z
+static void grid(int size, float extent, float z, int &nVertices, MeshVisitor &visitor) {
+    const Vec3f normal(0, 0, 1);
+    int base = nVertices;
+    for (int i = 0; i <= size; ++i) {
+        for (int j = 0; j <= size; ++j) {
+            float x = extent * (2.f * j / size - 1), y = extent * (2.f * i / size - 1);
+            visitor.vertex(Vec3f(x, y, z), square_uv(x / extent, y / extent), normal);
+        }
+    }
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            int a = base + i * (size + 1) + j;
+            int b = a + size + 1;
+            visitor.face(a, a + 1, b);
+            visitor.face(a + 1, b + 1, b);
+        }
+    }
+    nVertices += (size + 1) * (size + 1);
+}
+
+static long long overdraw(long long triangles, MeshVisitor &visitor) {
+    const int layers = 16;
+    int size = std::max(1, int(std::sqrt(double(triangles) / layers / 2) + .5));
+    int nVertices = 0;
+    for (int layer = 0; layer < layers; ++layer)
+        grid(size, .9f, -.6f + 1.2f * layer / (layers - 1), nVertices, visitor);
+    return 2LL * size * size * layers;
+}
+
+static long long offscreen(long long triangles, MeshVisitor &visitor) {
+    int size = std::max(1, int(std::sqrt(double(triangles) / 2) + .5));
+    int nVertices = 0;
+    grid(size, 4.f, 0.f, nVertices, visitor);
+    return 2LL * size * size;
+}
+
+long long generate_scene(const SceneSpec &spec, MeshVisitor &visitor) {
+    switch (spec.kind) {
+        case SPHERE:
+            return sphere(spec.triangles, visitor);
+        case SLIVERS:
+            return slivers(spec.triangles, visitor);
+        case OVERDRAW:
+            return overdraw(spec.triangles, visitor);
+        case OFFSCREEN:
+            return offscreen(spec.triangles, visitor);
+        default:
+            return 0;
+    }
+}
+
+TGAImage scene_texture() {
+    const int size = 512;
+    TGAImage texture(size, size, TGAImage::RGB);
+    for (int j = 0; j < size; ++j) {
+        for (int i = 0; i < size; ++i) {
+            bool dark = (i / 32 + j / 32) % 2;
+            auto r = static_cast<uint8_t>(i / 2), g = static_cast<uint8_t>(j / 2);
+            texture.set(i, j, dark ? TGAColor(r / 2, g / 2, 64) : TGAColor(r, g, 255));
+        }
+    }
+    return texture;
+}
+
+class ModelBuilder : public MeshVisitor {
+public:
+    std::vector<Vec3f> vertices;
+    std::vector<Vec2f> uvs;
+    std::vector<Vec3f> norms;
+    std::vector<std::vector<Vec3i>> faces;
+
+    void vertex(const Vec3f &position, const Vec2f &uv, const Vec3f &normal) override {
+        vertices.push_back(position);
+        uvs.push_back(uv);
+        norms.push_back(normal);
+    }
+
+    void face(int a, int b, int c) override {
+        faces.push_back({Vec3i(a, a, a), Vec3i(b, b, b), Vec3i(c, c, c)});
+    }
+};
+
+Model *generate_model(const SceneSpec &spec) {
+    ModelBuilder builder;
+    generate_scene(spec, builder);
+    std::shared_ptr<TGAImage> texture = std::make_shared<TGAImage>(scene_texture());
+    // textures are kept bottom-up in memory, like the ones the cache loads
+    texture->flip_vertically();
+    return new Model(std::move(builder.vertices), std::move(builder.uvs), std::move(builder.norms),
+                     std::move(builder.faces), texture);
+}
+
+class ObjWriter : public MeshVisitor {
+public:
+    explicit ObjWriter(FILE *out) : out(out) {}
+
+    void vertex(const Vec3f &position, const Vec2f &uv, const Vec3f &normal) override {
+        fprintf(out, "v %.6g %.6g %.6g\nvt %.6g %.6g 0\nvn %.6g %.6g %.6g\n", position.x, position.y, position.z,
+                uv.x, uv.y, normal.x, normal.y, normal.z);
+    }
+
+    void face(int a, int b, int c) override {
+        fprintf(out, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a + 1, a + 1, a + 1, b + 1, b + 1, b + 1, c + 1, c + 1, c + 1);
+    }
+
+private:
+    FILE *out;
+};
+
+bool write_scene_obj(const SceneSpec &spec, const std::string &filename) {
+    FILE *out = fopen(filename.c_str(), "w");
+    if (!out) {
+        std::cerr << "Can't open file " << filename << '\n';
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+
+    ObjWriter writer(out);
+    long long faces = generate_scene(spec, writer);
+    bool is_ok = !ferror(out);
+    is_ok = fclose(out) == 0 && is_ok;
+    if (!is_ok) {
+        std::cerr << "Can't write file " << filename << '\n';
+        return false;
+    }
+    std::cerr << "# generated " << scene_name(spec.kind) << " with " << faces << " faces into " << filename
+              << std::endl;
+
+    size_t dot = filename.find_last_of('.');
+    return scene_texture().write_tga_file(filename.substr(0, dot) + "_diffuse.tga");
+}
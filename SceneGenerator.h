@@ -0,0 +1,53 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_SCENEGENERATOR_H
+#define SIMPLESOFTWARERENDERER_SCENEGENERATOR_H
+
+#include <string>
+#include "geometry.h"
+#include "Model.h"
+#include "TGAImage.h"
+
+// Procedural stress scenes for scaling studies, all with UVs and normals and sized for the default camera.
+// SPHERE is a UV sphere, SLIVERS long triangles a few hundredths of a pixel wide, OVERDRAW a stack of
+// screen-filling layers drawn back to front (every layer passes the depth test), OFFSCREEN a large plane of which
+// only a few percent is inside the viewport.
+enum SceneKind {
+    SPHERE, SLIVERS, OVERDRAW, OFFSCREEN, N_SCENE_KINDS
+};
+
+struct SceneSpec {
+    SceneKind kind;
+    long long triangles;    // requested count, the generated mesh rounds it to its own grid
+};
+
+// "sphere:100000", the count may end with K or M ("slivers:2M")
+bool parse_scene(const std::string &text, SceneSpec &spec);
+
+const char *scene_name(SceneKind kind);
+
+// receives the generated mesh; a vertex carries its position, uv and normal under a single index
+class MeshVisitor {
+public:
+    virtual ~MeshVisitor() = default;
+
+    virtual void vertex(const Vec3f &position, const Vec2f &uv, const Vec3f &normal) = 0;
+
+    // indices of earlier vertices, counted from 0
+    virtual void face(int a, int b, int c) = 0;
+};
+
+// streams the scene into the visitor and returns the number of faces generated
+long long generate_scene(const SceneSpec &spec, MeshVisitor &visitor);
+
+// the diffuse texture every generated scene uses
+TGAImage scene_texture();
+
+Model *generate_model(const SceneSpec &spec);
+
+// writes the scene as OBJ without holding it in memory, plus the matching _diffuse.tga next to it
+bool write_scene_obj(const SceneSpec &spec, const std::string &filename);
+
+#endif //SIMPLESOFTWARERENDERER_SCENEGENERATOR_H
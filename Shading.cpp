@@ -0,0 +1,89 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include "Shading.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static inline uint16_t quantize(float intensity) {
+    intensity = intensity > 0 ? (intensity < 1 ? intensity : 1) : 0;   // NaN goes to 0 like in the SIMD paths
+    return static_cast<uint16_t>(intensity * 256.f + .5f);
+}
+
+static inline uint32_t modulate(uint32_t texel, uint32_t q) {
+    uint32_t res = 0;
+    for (int i = 0; i < 4; ++i)
+        res |= ((((texel >> (8 * i)) & 0xff) * q) >> 8) << (8 * i);
+    return res;
+}
+
+void shade_fragments_scalar(const uint32_t *texels, const float *intensity, uint32_t *out, int n) {
+    for (int i = 0; i < n; ++i)
+        out[i] = modulate(texels[i], quantize(intensity[i]));
+}
+
+#if defined(__SSE2__)
+
+// q for 4 fragments, clamped and rounded like quantize()
+static inline __m128i quantize4(const float *intensity) {
+    __m128 ity = _mm_loadu_ps(intensity);
+    ity = _mm_min_ps(_mm_max_ps(ity, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(ity, _mm_set1_ps(256.f)), _mm_set1_ps(.5f)));
+}
+
+// two BGRA pixels widened to 16 bit lanes times their q, back to 8 bit
+static inline __m128i modulate2(__m128i pixels16, __m128i q16) {
+    return _mm_srli_epi16(_mm_mullo_epi16(pixels16, q16), 8);
+}
+
+#endif
+
+void shade_fragments(const uint32_t *texels, const float *intensity, uint32_t *out, int n) {
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i q = _mm256_set_m128i(quantize4(intensity + i + 4), quantize4(intensity + i));
+        // every q is repeated over the 4 channels of its pixel
+        __m256i q16 = _mm256_packs_epi32(q, q);                    // q0..q3 q0..q3 | q4..q7 q4..q7
+        __m256i qlo = _mm256_unpacklo_epi16(q16, q16);             // q0 q0 q1 q1 q2 q2 q3 q3 | q4..
+        __m256i qA = _mm256_unpacklo_epi32(qlo, qlo);              // q0 x4 q1 x4 | q4 x4 q5 x4
+        __m256i qB = _mm256_unpackhi_epi32(qlo, qlo);              // q2 x4 q3 x4 | q6 x4 q7 x4
+
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(texels + i));
+        __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), qA), 8);
+        __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), qB), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_packus_epi16(lo, hi));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i q = quantize4(intensity + i);
+        __m128i q16 = _mm_packs_epi32(q, q);                       // q0 q1 q2 q3 q0 q1 q2 q3
+        __m128i qlo = _mm_unpacklo_epi16(q16, q16);                // q0 q0 q1 q1 q2 q2 q3 q3
+        __m128i qA = _mm_unpacklo_epi32(qlo, qlo);                 // q0 x4 q1 x4
+        __m128i qB = _mm_unpackhi_epi32(qlo, qlo);                 // q2 x4 q3 x4
+
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(texels + i));
+        __m128i lo = modulate2(_mm_unpacklo_epi8(pixels, zero), qA);
+        __m128i hi = modulate2(_mm_unpackhi_epi8(pixels, zero), qB);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    shade_fragments_scalar(texels + i, intensity + i, out + i, n - i);
+}
+
+const char *shading_isa() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,75 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_SHADING_H
+#define SIMPLESOFTWARERENDERER_SHADING_H
+
+#include <cstdint>
+#include <cstring>
+#include "TGAImage.h"
+#include "geometry.h"
+
+// Texel x intensity modulation of a batch of fragments in 8.8 fixed point.
+// The intensity is clamped to [0, 1] and rounded to q = round(intensity * 256), every BGRA channel becomes
+// (c * q) >> 8. Compared with the float TGAColor::operator*(float) a channel differs by at most 1 LSB
+// (|c * (q / 256 - intensity)| <= 255 / 512), it is exact for intensity 0 and 1.
+// The SIMD paths (AVX2 or SSE2, whichever the compiler targets) are bit-exact with the scalar one.
+void shade_fragments(const uint32_t *texels, const float *intensity, uint32_t *out, int n);
+
+void shade_fragments_scalar(const uint32_t *texels, const float *intensity, uint32_t *out, int n);
+
+// "avx2", "sse2" or "scalar"
+const char *shading_isa();
+
+// texel at (x, y) packed as BGRA (missing channels are zero), 0 outside the texture or without one
+inline uint32_t fetch_texel(const TGAImage *texture, int x, int y) {
+    if (!texture || x < 0 || y < 0 || x >= texture->get_width() || y >= texture->get_height())
+        return 0;
+    const int bpp = texture->get_bytesPerPixel();
+    const uint8_t *p = texture->buffer() + (x + y * texture->get_width()) * bpp;
+    uint32_t texel = 0;
+    for (int i = 0; i < bpp; ++i)
+        texel |= uint32_t(p[i]) << (8 * i);
+    return texel;
+}
+
+// Twice the signed area of the triangle a, b, (x, y), in 64 bits so screen coordinates far outside the view do not
+// overflow. Divided by the area of a triangle, the edges opposite its corners are the barycentric weights of
+// (x, y), negative outside whatever the winding.
+inline int64_t edge(const Vec3i &a, const Vec3i &b, int64_t x, int64_t y) {
+    return (int64_t(b.x) - a.x) * (y - a.y) - (int64_t(b.y) - a.y) * (x - a.x);
+}
+
+inline void barycentric(const Vec3i t[3], float inverseArea, int x, int y, float &b0, float &b1, float &b2) {
+    b0 = edge(t[1], t[2], x, y) * inverseArea;
+    b1 = edge(t[2], t[0], x, y) * inverseArea;
+    b2 = edge(t[0], t[1], x, y) * inverseArea;
+}
+
+// texel at the texture coordinates interpolated with the barycentric weights, white without a texture
+inline uint32_t interpolate_texel(const TGAImage *texture, const Vec2i uv[3], float b0, float b1, float b2) {
+    if (!texture)
+        return 0xffffffff;
+    return fetch_texel(texture, int(uv[0].x * b0 + uv[1].x * b1 + uv[2].x * b2),
+                       int(uv[0].y * b0 + uv[1].y * b1 + uv[2].y * b2));
+}
+
+// fragments that passed the z-test, shaded together once the batch is full and written at their pixel offsets
+struct FragmentBatch {
+    static const int size = 64;
+    size_t offsets[size];
+    uint32_t texels[size];
+    float intensities[size];
+    uint32_t shaded[size];
+    int n;
+
+    void flush(uint8_t *data, int bpp) {
+        shade_fragments(texels, intensities, shaded, n);
+        for (int k = 0; k < n; ++k)
+            memcpy(data + offsets[k] * bpp, &shaded[k], bpp);
+        n = 0;
+    }
+};
+
+#endif //SIMPLESOFTWARERENDERER_SHADING_H
@@ -0,0 +1,164 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Arena.h"
+#include "Renderer.h"
+#include "SortLast.h"
+
+struct WorkerTiming {
+    double renderSeconds;
+    double compositeSeconds;
+};
+
+struct Slot {
+    uint8_t *color;
+    int *zBuffer;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// dst keeps its pixel unless src is strictly closer: src always holds the later faces
+static void merge(Slot dst, Slot src, size_t nPixels, int bpp) {
+    for (size_t i = 0; i < nPixels; ++i) {
+        if (src.zBuffer[i] > dst.zBuffer[i]) {
+            dst.zBuffer[i] = src.zBuffer[i];
+            memcpy(dst.color + i * bpp, src.color + i * bpp, bpp);
+        }
+    }
+}
+
+static bool run_worker(int k, int nWorkers, Model *model, Matrix &transformMatrix, const Vec3f &lightDirection,
+                       int32_t width, int32_t height, uint8_t bpp, Framebuffer::Layout layout,
+                       std::vector<Slot> &slots, WorkerTiming *timing, std::vector<int> &readEnds, int writeEnd) {
+    auto start = std::chrono::steady_clock::now();
+
+    // the merge works on pixel indices, so the partial images only need the same layout as the target
+    Framebuffer partial(width, height, bpp, layout);
+    size_t nPixels = partial.pixel_count();
+    FrameArena arena;
+    int nFaces = model->nFaces();
+    render(model, transformMatrix, lightDirection, partial, arena, int(int64_t(nFaces) * k / nWorkers),
+           int(int64_t(nFaces) * (k + 1) / nWorkers));
+    memcpy(slots[k].color, partial.pixels(), nPixels * bpp);
+    memcpy(slots[k].zBuffer, partial.zBuffer.data(), nPixels * sizeof(int));
+    timing[k].renderSeconds = seconds_since(start);
+
+    for (int stride = 1; stride < nWorkers && k % (2 * stride) == 0; stride *= 2) {
+        int other = k + stride;
+        if (other >= nWorkers)
+            continue;
+
+        char done;
+        if (read(readEnds[other], &done, 1) != 1)
+            return false;
+        auto mergeStart = std::chrono::steady_clock::now();
+        merge(slots[k], slots[other], nPixels, bpp);
+        timing[k].compositeSeconds += seconds_since(mergeStart);
+    }
+
+    char done = 1;
+    return write(writeEnd, &done, 1) == 1;
+}
+
+bool render_sort_last(Model *model, Matrix &transformMatrix, const Vec3f &lightDirection, Framebuffer &framebuffer,
+                      int nWorkers, SortLastStats &stats) {
+    auto start = std::chrono::steady_clock::now();
+    const int32_t width = framebuffer.get_width();
+    const int32_t height = framebuffer.get_height();
+    const uint8_t bpp = framebuffer.color.get_bytesPerPixel();
+    const size_t nPixels = framebuffer.pixel_count();
+
+    auto align = [](size_t n) { return (n + 63) & ~size_t(63); };
+    const size_t header = align(sizeof(WorkerTiming) * nWorkers);
+    const size_t colorBytes = align(nPixels * bpp);
+    const size_t slotBytes = colorBytes + align(nPixels * sizeof(int));
+    const size_t sharedBytes = header + slotBytes * nWorkers;
+
+    void *shared = mmap(nullptr, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        std::cerr << "Can't map the shared framebuffers\n";
+        return false;
+    }
+    auto *timing = static_cast<WorkerTiming *>(shared);
+    std::vector<Slot> slots(static_cast<size_t>(nWorkers));
+    for (int k = 0; k < nWorkers; ++k) {
+        uint8_t *base = static_cast<uint8_t *>(shared) + header + slotBytes * k;
+        slots[k] = {base, reinterpret_cast<int *>(base + colorBytes)};
+    }
+
+    // pipe k carries the "worker k has finished its subtree" token to the worker merging it
+    std::vector<int> readEnds(static_cast<size_t>(nWorkers), -1), writeEnds(static_cast<size_t>(nWorkers), -1);
+    bool is_ok = true;
+    for (int k = 0; k < nWorkers && is_ok; ++k) {
+        int fds[2];
+        is_ok = pipe(fds) == 0;
+        if (is_ok) {
+            readEnds[k] = fds[0];
+            writeEnds[k] = fds[1];
+        }
+    }
+
+    std::cerr.flush();
+    std::vector<pid_t> workers;
+    for (int k = 0; k < nWorkers && is_ok; ++k) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            // keep only our own write end, so a crashed worker shows up as EOF to its merger
+            for (int i = 0; i < nWorkers; ++i) {
+                if (i != k)
+                    close(writeEnds[i]);
+            }
+            bool worker_ok = run_worker(k, nWorkers, model, transformMatrix, lightDirection, width, height, bpp,
+                                        framebuffer.get_layout(), slots, timing, readEnds, writeEnds[k]);
+            _exit(worker_ok ? 0 : 1);
+        }
+        if (pid < 0) {
+            std::cerr << "Can't fork a sort-last worker\n";
+            is_ok = false;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    for (int k = 0; k < nWorkers; ++k) {
+        if (writeEnds[k] >= 0)
+            close(writeEnds[k]);
+    }
+    for (pid_t pid : workers) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            is_ok = false;
+    }
+    for (int k = 0; k < nWorkers; ++k) {
+        if (readEnds[k] >= 0)
+            close(readEnds[k]);
+    }
+
+    if (is_ok) {
+        memcpy(framebuffer.pixels(), slots[0].color, nPixels * bpp);
+        memcpy(framebuffer.zBuffer.data(), slots[0].zBuffer, nPixels * sizeof(int));
+
+        stats.renderSeconds = 0;
+        for (int k = 0; k < nWorkers; ++k)
+            stats.renderSeconds = std::max(stats.renderSeconds, timing[k].renderSeconds);
+        // worker 0 takes part in every round, its merges are the critical path
+        stats.compositeSeconds = timing[0].compositeSeconds;
+    } else {
+        std::cerr << "Sort-last rendering failed\n";
+    }
+    stats.totalSeconds = seconds_since(start);
+
+    munmap(shared, sharedBytes);
+    return is_ok;
+}
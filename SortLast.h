@@ -0,0 +1,27 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_SORTLAST_H
+#define SIMPLESOFTWARERENDERER_SORTLAST_H
+
+#include "Framebuffer.h"
+#include "Model.h"
+#include "geometry.h"
+
+struct SortLastStats {
+    double renderSeconds;      // slowest worker
+    double compositeSeconds;   // merges on the critical path of the reduction tree
+    double totalSeconds;       // fork to final image
+};
+
+// Sort-last parallel rendering. The faces are split into nWorkers contiguous ranges, each rendered by its
+// own forked process into a full color + z-buffer in shared memory. The partial framebuffers are then
+// merged by depth in a binary tree: in round r worker k (k divisible by 2^(r+1)) merges in the result of
+// worker k + 2^r, so log2(nWorkers) rounds of merges run in parallel and worker 0 ends up with the image.
+// A merge only takes the later range's pixel when it is strictly closer, which is exactly the tie-breaking
+// of the single-process z-test, so the output is identical to render().
+bool render_sort_last(Model *model, Matrix &transformMatrix, const Vec3f &lightDirection, Framebuffer &framebuffer,
+                      int nWorkers, SortLastStats &stats);
+
+#endif //SIMPLESOFTWARERENDERER_SORTLAST_H
@@ -0,0 +1,151 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Renderer.h"
+#include "StreamingRenderer.h"
+#include "Trace.h"
+
+StreamingRenderer::StreamingRenderer(ChunkReader &reader, size_t chunkBytes)
+        : reader(reader), pool(std::max(chunkBytes, sizeof(SoupTriangle)), 2), chunks(), diffuse() {
+    for (MeshChunk &chunk : chunks) {
+        chunk.triangles = static_cast<SoupTriangle *>(pool.allocate());
+        chunk.count = 0;
+        chunk.capacity = pool.get_block_size() / sizeof(SoupTriangle);
+    }
+
+    std::string textureFile = reader.texture_file();
+    if (!textureFile.empty())
+        diffuse = TextureCache::instance().get(textureFile);
+}
+
+StreamingRenderer::~StreamingRenderer() {
+    for (MeshChunk &chunk : chunks)
+        pool.deallocate(chunk.triangles);
+}
+
+size_t StreamingRenderer::get_chunk_triangles() const {
+    return chunks[0].capacity;
+}
+
+StreamingRenderer::Stats StreamingRenderer::render(Matrix &transformMatrix, const Vec3f &lightDirection,
+                                                   Framebuffer &framebuffer) {
+    Stats stats{};
+    auto start = std::chrono::steady_clock::now();
+    const float width = framebuffer.get_width();
+    const float height = framebuffer.get_height();
+
+    // whole chunks that project outside the screen are skipped (by the binary format without reading them)
+    reader.set_filter([&transformMatrix, width, height](const Vec3f &lo, const Vec3f &hi) {
+        float xMin = width, yMin = height, xMax = -1, yMax = -1;
+        for (int i = 0; i < 8; ++i) {
+            Vec3f corner(i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z);
+            Vec3f s = transformMatrix.transform(corner);
+            xMin = std::min(xMin, s.x);
+            yMin = std::min(yMin, s.y);
+            xMax = std::max(xMax, s.x);
+            yMax = std::max(yMax, s.y);
+        }
+        return xMax >= 0 && yMax >= 0 && xMin < width && yMin < height;
+    });
+    reader.rewind();
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool filled[2] = {false, false};
+    bool finished = false;
+
+    std::thread producer([&] {
+        Trace::set_thread_name("chunk reader");
+        for (int i = 0;; i ^= 1) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return !filled[i]; });
+            }
+            bool more;
+            {
+                Trace::Span span("read chunk");
+                more = reader.next(chunks[i]);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (more)
+                    filled[i] = true;
+                else
+                    finished = true;
+            }
+            changed.notify_all();
+            if (!more)
+                return;
+        }
+    });
+
+    for (int i = 0;; i ^= 1) {
+        auto waitStart = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return filled[i] || finished; });
+            if (!filled[i])
+                break;
+        }
+        stats.readWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+
+        {
+            Trace::Span span("raster chunk", static_cast<int64_t>(chunks[i].count));
+            rasterize(chunks[i], transformMatrix, lightDirection, framebuffer, stats);
+        }
+        stats.chunks++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            filled[i] = false;
+        }
+        changed.notify_all();
+    }
+    producer.join();
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+void StreamingRenderer::rasterize(const MeshChunk &chunk, Matrix &transformMatrix, const Vec3f &lightDirection,
+                                  Framebuffer &framebuffer, Stats &stats) {
+    const int width = framebuffer.get_width();
+    const int height = framebuffer.get_height();
+    const int textureWidth = diffuse ? diffuse->get_width() : 0;
+    const int textureHeight = diffuse ? diffuse->get_height() : 0;
+
+    for (size_t i = 0; i < chunk.count; ++i) {
+        const SoupTriangle &t = chunk.triangles[i];
+        stats.triangles++;
+
+        Vec3f screen[3];
+        for (int j = 0; j < 3; ++j)
+            screen[j] = transformMatrix.transform(t.position[j]);
+
+        float xMin = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+        float xMax = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+        float yMin = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+        float yMax = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+        if (xMax < 0 || yMax < 0 || xMin >= width || yMin >= height) {
+            stats.culledTriangles++;
+            continue;
+        }
+
+        Vec3i screen_c[3];
+        Vec2i uv[3];
+        float intensity[3];
+        for (int j = 0; j < 3; ++j) {
+            screen_c[j] = screen[j];
+            Vec3f n = t.normal[j];
+            intensity[j] = n.normalize() * lightDirection;
+            uv[j] = Vec2i(static_cast<int>(t.uv[j].x * textureWidth), static_cast<int>(t.uv[j].y * textureHeight));
+        }
+
+        triangle(screen_c, uv, intensity, diffuse.get(), framebuffer);
+    }
+}
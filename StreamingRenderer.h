@@ -0,0 +1,50 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_STREAMINGRENDERER_H
+#define SIMPLESOFTWARERENDERER_STREAMINGRENDERER_H
+
+#include "Arena.h"
+#include "Framebuffer.h"
+#include "MeshStream.h"
+#include "TextureCache.h"
+#include "geometry.h"
+
+// Out-of-core renderer: the mesh is never held in memory as a whole. Chunks of triangles are read
+// into two fixed buffers; while one is transformed, culled and rasterized into the persistent
+// framebuffer, a reader thread fills the other.
+class StreamingRenderer {
+public:
+    struct Stats {
+        size_t chunks;
+        size_t triangles;
+        size_t culledTriangles;
+        double seconds;
+        double readWaitSeconds;   // time the rasterizer waited for the reader
+    };
+
+    StreamingRenderer(ChunkReader &reader, size_t chunkBytes);
+
+    ~StreamingRenderer();
+
+    StreamingRenderer(const StreamingRenderer &) = delete;
+
+    StreamingRenderer &operator=(const StreamingRenderer &) = delete;
+
+    // one pass over the whole mesh
+    Stats render(Matrix &transformMatrix, const Vec3f &lightDirection, Framebuffer &framebuffer);
+
+    size_t get_chunk_triangles() const;
+
+private:
+    ChunkReader &reader;
+    FixedPool pool;
+    MeshChunk chunks[2];
+    TextureCache::Texture diffuse;
+
+    void rasterize(const MeshChunk &chunk, Matrix &transformMatrix, const Vec3f &lightDirection,
+                   Framebuffer &framebuffer, Stats &stats);
+};
+
+#endif //SIMPLESOFTWARERENDERER_STREAMINGRENDERER_H
@@ -2,8 +2,10 @@
 // Created by ju5t on 29.01.19.
 //
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include "ImageOps.h"
 #include "TGAImage.h"
 
 bool TGAImage::load_rle_data(std::ifstream &in) {
@@ -63,7 +65,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 }
 
 //TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
+bool TGAImage::unload_rle_data(std::ofstream &out) const {
     const uint8_t max_chunk_length = 128;
     uint64_t nPixels = width * height;
     uint64_t curPixel = 0;
@@ -205,7 +207,7 @@ bool TGAImage::read_tga_file(std::string filename) {
     return true;
 }
 
-bool TGAImage::write_tga_file(std::string filename, bool rle) {
+bool TGAImage::write_tga_file(std::string filename, bool rle) const {
     uint8_t developer_area_ref[4] = {0, 0, 0, 0};
     uint8_t extension_area_ref[4] = {0, 0, 0, 0};
     uint8_t footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O', 'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
@@ -277,16 +279,7 @@ bool TGAImage::flip_horizontally() {
     if (!data)
         return false;
 
-    int half = width >> 1;
-
-    for (int i = 0; i < half; i++) {
-        for (int j = 0; j < height; j++) {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width - 1 - i, j);
-            set(i, j, c2);
-            set(width - 1 - i, j, c1);
-        }
-    }
+    ::flip_horizontally(*this);
     return true;
 }
 
@@ -294,18 +287,7 @@ bool TGAImage::flip_vertically() {
     if (!data)
         return false;
 
-    uint64_t bytes_per_line = width * bytesPerPixel;
-    auto *line = new uint8_t[bytes_per_line];
-    int half = height >> 1;
-
-    for (int j = 0; j < half; j++) {
-        uint64_t l1 = j * bytes_per_line;
-        uint64_t l2 = (height - 1 - j) * bytes_per_line;
-        memmove(line, (data + l1), bytes_per_line);
-        memmove((data + l1), (data + l2), bytes_per_line);
-        memmove((data + l2), line, bytes_per_line);
-    }
-    delete[] line;
+    ::flip_vertically(*this);
     return true;
 }
 
@@ -353,7 +335,7 @@ bool TGAImage::scale(const int32_t &w, const int32_t &h) {
     return true;
 }
 
-TGAColor TGAImage::get(const int32_t &x, const int32_t &y) {
+TGAColor TGAImage::get(const int32_t &x, const int32_t &y) const {
     if (!data || x < 0 || y < 0 || x >= width || y >= height) {
         return {};
     }
@@ -368,15 +350,15 @@ bool TGAImage::set(const int32_t &x, const int32_t &y, const TGAColor &c) {
     return true;
 }
 
-int32_t TGAImage::get_width() {
+int32_t TGAImage::get_width() const {
     return width;
 }
 
-int32_t TGAImage::get_height() {
+int32_t TGAImage::get_height() const {
     return height;
 }
 
-uint8_t TGAImage::get_bytesPerPixel() {
+uint8_t TGAImage::get_bytesPerPixel() const {
     return bytesPerPixel;
 }
 
@@ -384,6 +366,10 @@ uint8_t *TGAImage::buffer() {
     return data;
 }
 
+const uint8_t *TGAImage::buffer() const {
+    return data;
+}
+
 void TGAImage::clear() {
     memset(data, 0, width * height * bytesPerPixel);
 }
@@ -79,7 +79,7 @@ protected:
 
     bool load_rle_data(std::ifstream &in);
 
-    bool unload_rle_data(std::ofstream &out);
+    bool unload_rle_data(std::ofstream &out) const;
 
 public:
     enum Format {
@@ -98,7 +98,7 @@ public:
 
     bool read_tga_file(std::string filename);
 
-    bool write_tga_file(std::string filename, bool rle = true);
+    bool write_tga_file(std::string filename, bool rle = true) const;
 
     bool flip_horizontally();
 
@@ -106,18 +106,20 @@ public:
 
     bool scale(const int32_t &w, const int32_t &h);
 
-    TGAColor get(const int32_t &x, const int32_t &y);
+    TGAColor get(const int32_t &x, const int32_t &y) const;
 
     bool set(const int32_t &x, const int32_t &y, const TGAColor &c);
 
-    int32_t get_width();
+    int32_t get_width() const;
 
-    int32_t get_height();
+    int32_t get_height() const;
 
-    uint8_t get_bytesPerPixel();
+    uint8_t get_bytesPerPixel() const;
 
     uint8_t *buffer();
 
+    const uint8_t *buffer() const;
+
     void clear();
 };
 
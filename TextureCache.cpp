@@ -0,0 +1,146 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <iostream>
+#include <sys/stat.h>
+#include "AllocStats.h"
+#include "TextureCache.h"
+#include "Trace.h"
+
+static time_t modification_time(const std::string &filename) {
+    struct stat st{};
+    if (stat(filename.c_str(), &st) != 0)
+        return 0;
+    return st.st_mtime;
+}
+
+TextureCache &TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+TextureCache::TextureCache() : mutex(), queueChanged(), queue(), entries(), lru(), budget(size_t(512) << 20),
+                               usage(0), stopping(false), loader() {
+    loader = std::thread(&TextureCache::loader_loop, this);
+}
+
+TextureCache::~TextureCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    loader.join();
+}
+
+TextureCache::PendingTexture TextureCache::request(const std::string &filename) {
+    time_t mtime = modification_time(filename);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(filename);
+    if (it != entries.end()) {
+        if (it->second.mtime == mtime) {
+            lru.splice(lru.begin(), lru, it->second.lru);
+            return it->second.texture;
+        }
+        // the file has changed on disk: forget the old version, its holders keep their copy
+        usage -= it->second.bytes;
+        lru.erase(it->second.lru);
+        entries.erase(it);
+    }
+
+    Job job{filename, mtime, std::make_shared<std::promise<Texture>>()};
+    lru.push_front(filename);
+    Entry entry{mtime, job.promise->get_future().share(), 0, lru.begin()};
+    entries.emplace(filename, entry);
+    queue.push_back(std::move(job));
+    queueChanged.notify_one();
+    return entry.texture;
+}
+
+TextureCache::Texture TextureCache::get(const std::string &filename) {
+    return request(filename).get();
+}
+
+void TextureCache::set_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    evict_locked();
+}
+
+size_t TextureCache::get_budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+size_t TextureCache::memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usage;
+}
+
+void TextureCache::evict() {
+    std::lock_guard<std::mutex> lock(mutex);
+    evict_locked();
+}
+
+void TextureCache::loader_loop() {
+    AllocStats::Scope stage(AllocStats::LOAD);
+    Trace::set_thread_name("texture loader");
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        Trace::Span span("texture load");
+        auto img = std::make_shared<TGAImage>();
+        bool is_ok = img->read_tga_file(job.filename);
+        std::cerr << "texture file " << job.filename << " loading " << (is_ok ? "ok" : "failed") << std::endl;
+
+        Texture texture;
+        if (is_ok) {
+            img->flip_vertically();
+            texture = img;
+        }
+        loaded(job.filename, job.mtime, texture);
+        job.promise->set_value(texture);
+    }
+}
+
+void TextureCache::loaded(const std::string &filename, time_t mtime, const Texture &texture) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(filename);
+    if (it == entries.end() || it->second.mtime != mtime)
+        return;
+
+    if (texture) {
+        it->second.bytes = static_cast<size_t>(texture->get_width()) * texture->get_height() *
+                           texture->get_bytesPerPixel();
+        usage += it->second.bytes;
+    }
+    evict_locked();
+}
+
+void TextureCache::evict_locked() {
+    auto it = lru.end();
+    while (usage > budget && it != lru.begin()) {
+        --it;
+        auto entry = entries.find(*it);
+        const PendingTexture &texture = entry->second.texture;
+        if (texture.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            continue;
+        // the entry itself owns one reference, anything above that is a model still using the texture
+        if (texture.get().use_count() > 1)
+            continue;
+
+        usage -= entry->second.bytes;
+        entries.erase(entry);
+        it = lru.erase(it);
+    }
+}
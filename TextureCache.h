@@ -0,0 +1,84 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_TEXTURECACHE_H
+#define SIMPLESOFTWARERENDERER_TEXTURECACHE_H
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "TGAImage.h"
+
+// Process-wide texture cache. Textures are keyed by path and modification time,
+// decoded on a background thread and shared between all models referencing them.
+// A texture stays alive while someone holds its pointer; textures nobody holds any more
+// are evicted in LRU order once the cache goes over its memory budget.
+class TextureCache {
+public:
+    typedef std::shared_ptr<const TGAImage> Texture;   // nullptr if the file could not be loaded
+    typedef std::shared_future<Texture> PendingTexture;
+
+    static TextureCache &instance();
+
+    // queues the texture for loading (if it is not cached yet) and returns immediately
+    PendingTexture request(const std::string &filename);
+
+    // the same as request(filename).get()
+    Texture get(const std::string &filename);
+
+    void set_budget(size_t bytes);
+
+    size_t get_budget() const;
+
+    size_t memory_usage() const;
+
+    void evict();
+
+    TextureCache(const TextureCache &) = delete;
+
+    TextureCache &operator=(const TextureCache &) = delete;
+
+    ~TextureCache();
+
+private:
+    struct Entry {
+        time_t mtime;
+        PendingTexture texture;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Job {
+        std::string filename;
+        time_t mtime;
+        std::shared_ptr<std::promise<Texture>> promise;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Job> queue;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru; // most recently used first
+    size_t budget;
+    size_t usage;
+    bool stopping;
+    std::thread loader;
+
+    TextureCache();
+
+    void loader_loop();
+
+    void loaded(const std::string &filename, time_t mtime, const Texture &texture);
+
+    void evict_locked();
+};
+
+#endif //SIMPLESOFTWARERENDERER_TEXTURECACHE_H
@@ -0,0 +1,100 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+static int defaultThreads = 0;
+
+// set while the thread runs a body; a nested parallel_for from it would otherwise try_lock the submit mutex it holds
+static thread_local bool inBody = false;
+
+ThreadPool::ThreadPool(int nThreads) : workers(), submitMutex(), mutex(), wake(), finished(), current(),
+                                       stopping(false) {
+    for (int i = 1; i < nThreads; ++i)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool(defaultThreads > 0 ? defaultThreads
+                                              : std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    return pool;
+}
+
+void ThreadPool::set_default_threads(int nThreads) {
+    defaultThreads = nThreads;
+}
+
+int ThreadPool::size() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body) {
+    if (begin >= end)
+        return;
+    grain = std::max(1, grain);
+    std::unique_lock<std::mutex> submit(submitMutex, std::defer_lock);
+    if (inBody || workers.empty() || end - begin <= grain || !submit.try_lock()) {
+        body(begin, end);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->body = &body;
+    job->end = end;
+    job->grain = grain;
+    job->next = begin;
+    job->remaining = (end - begin + grain - 1) / grain;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = job;
+    }
+    wake.notify_all();
+
+    run(*job);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return job->remaining == 0; });
+    current.reset();
+}
+
+void ThreadPool::run(Job &job) {
+    while (true) {
+        int first = job.next.fetch_add(job.grain);
+        if (first >= job.end)
+            return;
+        inBody = true;
+        (*job.body)(first, std::min(job.end, first + job.grain));
+        inBody = false;
+        if (job.remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker_loop() {
+    std::shared_ptr<Job> seen;
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || (current && current != seen); });
+            if (stopping)
+                return;
+            job = seen = current;
+        }
+        // a worker that wakes up late only finds the chunks exhausted, the body is never called after the job ended
+        run(*job);
+    }
+}
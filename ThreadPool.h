@@ -0,0 +1,61 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_THREADPOOL_H
+#define SIMPLESOFTWARERENDERER_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread works along, so a pool of
+// size 1 has no workers and runs everything inline. A parallel_for issued while another one is running
+// (from a second thread or from inside a body) runs inline as well instead of queueing.
+class ThreadPool {
+public:
+    explicit ThreadPool(int nThreads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // process-wide pool, hardware_concurrency() threads unless set_default_threads() was called before first use
+    static ThreadPool &instance();
+
+    static void set_default_threads(int nThreads);
+
+    int size() const;
+
+    // body(first, last) over [begin, end) in chunks of at most grain items; returns when all chunks are done
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+private:
+    struct Job {
+        const std::function<void(int, int)> *body;
+        int end;
+        int grain;
+        std::atomic<int> next;
+        std::atomic<int> remaining;    // chunks not finished yet
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex submitMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::shared_ptr<Job> current;
+    bool stopping;
+
+    void worker_loop();
+
+    void run(Job &job);
+};
+
+#endif //SIMPLESOFTWARERENDERER_THREADPOOL_H
@@ -0,0 +1,138 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include "Trace.h"
+
+struct TraceEvent {
+    const char *name;
+    int64_t arg;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// single producer: only the owning thread writes events and head, the exporter only reads
+struct TraceRing {
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head;
+    int tid;
+    const char *threadName;
+};
+
+static std::atomic<bool> enabled(false);
+static std::atomic<size_t> ringEvents(size_t(1) << 16);
+static std::mutex ringsMutex;
+// rings outlive their threads, the writer and loader threads are gone by the time the trace is written
+static std::vector<std::unique_ptr<TraceRing>> rings;
+static thread_local TraceRing *threadRing = nullptr;
+static thread_local const char *threadName = nullptr;
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static TraceRing *ring() {
+    if (threadRing)
+        return threadRing;
+    std::unique_ptr<TraceRing> created(new TraceRing);
+    created->events.resize(ringEvents.load(std::memory_order_relaxed));
+    created->head = 0;
+    created->threadName = threadName;
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    created->tid = static_cast<int>(rings.size()) + 1;
+    threadRing = created.get();
+    rings.push_back(std::move(created));
+    return threadRing;
+}
+
+Trace::Span::Span(const char *name, int64_t arg) : name(name), arg(arg), start(0) {
+    if (enabled.load(std::memory_order_relaxed))
+        start = now_ns();
+}
+
+Trace::Span::~Span() {
+    if (!start || !enabled.load(std::memory_order_relaxed))
+        return;
+    TraceRing *r = ring();
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    r->events[head % r->events.size()] = TraceEvent{name, arg, start, now_ns() - start};
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::enable(size_t events) {
+    ringEvents = std::max(size_t(1), events);
+    enabled = true;
+}
+
+void Trace::disable() {
+    enabled = false;
+}
+
+bool Trace::is_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::set_thread_name(const char *name) {
+    threadName = name;
+    if (threadRing)
+        threadRing->threadName = name;
+}
+
+bool Trace::write_json(const std::string &filename) {
+    FILE *out = fopen(filename.c_str(), "w");
+    if (!out) {
+        std::cerr << "Can't open file " << filename << '\n';
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    uint64_t origin = UINT64_MAX;
+    for (const auto &r : rings) {
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t first = head > r->events.size() ? head - r->events.size() : 0;
+        for (uint64_t i = first; i < head; ++i)
+            origin = std::min(origin, r->events[i % r->events.size()].start);
+    }
+
+    const int pid = getpid();
+    size_t dropped = 0;
+    bool first = true;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (const auto &r : rings) {
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", pid, r->tid, r->threadName ? r->threadName : "thread");
+        first = false;
+
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t begin = head > r->events.size() ? head - r->events.size() : 0;
+        dropped += begin;
+        for (uint64_t i = begin; i < head; ++i) {
+            const TraceEvent &e = r->events[i % r->events.size()];
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"renderer\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                         "\"ts\":%.3f,\"dur\":%.3f", e.name, pid, r->tid, (e.start - origin) / 1e3, e.duration / 1e3);
+            if (e.arg >= 0)
+                fprintf(out, ",\"args\":{\"n\":%lld}", static_cast<long long>(e.arg));
+            fprintf(out, "}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    bool is_ok = !ferror(out);
+    is_ok = fclose(out) == 0 && is_ok;
+    if (!is_ok)
+        std::cerr << "Can't write file " << filename << '\n';
+    else if (dropped)
+        std::cerr << "# trace: " << dropped << " oldest spans were overwritten, raise the ring size" << std::endl;
+    return is_ok;
+}
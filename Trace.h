@@ -0,0 +1,47 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_TRACE_H
+#define SIMPLESOFTWARERENDERER_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Timeline tracer. Spans are recorded into a ring buffer owned by the recording thread, so recording takes no
+// locks; the oldest spans are overwritten when a ring is full. write_json() exports every thread's ring as
+// Chrome/Perfetto trace-event JSON (chrome://tracing, ui.perfetto.dev). Tracing is off by default and can be
+// switched at any time, a Span created while it is off costs one relaxed atomic load.
+class Trace {
+public:
+    // RAII span; name must outlive the trace (a string literal), arg is shown in the viewer when not negative
+    class Span {
+        const char *name;
+        int64_t arg;
+        uint64_t start;
+    public:
+        explicit Span(const char *name, int64_t arg = -1);
+
+        ~Span();
+
+        Span(const Span &) = delete;
+
+        Span &operator=(const Span &) = delete;
+    };
+
+    // spans per thread kept by rings created from now on
+    static void enable(size_t ringEvents = size_t(1) << 16);
+
+    static void disable();
+
+    static bool is_enabled();
+
+    // label of the calling thread in the viewer
+    static void set_thread_name(const char *name);
+
+    // call once the traced threads are idle, a span recorded during the export may come out torn
+    static bool write_json(const std::string &filename);
+};
+
+#endif //SIMPLESOFTWARERENDERER_TRACE_H
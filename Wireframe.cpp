@@ -0,0 +1,68 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include "AllocStats.h"
+#include "Renderer.h"
+#include "Wireframe.h"
+
+std::vector<Edge> unique_edges(Model *model) {
+    std::vector<uint64_t> keys;
+    keys.reserve(static_cast<size_t>(model->nFaces()) * 3);
+
+    for (int iFace = 0; iFace < model->nFaces(); ++iFace) {
+        for (int j = 0; j < 3; ++j) {
+            auto a = static_cast<uint32_t>(model->vert(iFace, j));
+            auto b = static_cast<uint32_t>(model->vert(iFace, (j + 1) % 3));
+            if (a > b)
+                std::swap(a, b);
+            keys.push_back(uint64_t(a) << 32 | b);
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<Edge> edges;
+    edges.reserve(keys.size());
+    for (uint64_t key : keys)
+        edges.push_back({static_cast<int>(key >> 32), static_cast<int>(key & 0xffffffffu)});
+    return edges;
+}
+
+int wireframe(Model *model, const std::vector<Edge> &edges, Matrix &transformMatrix, Framebuffer &framebuffer,
+              const TGAColor &color, bool depthTested, FrameArena &arena) {
+    Vec3f *screen;
+    {
+        AllocStats::Scope stage(AllocStats::VERTEX);
+        screen = arena.allocate<Vec3f>(static_cast<size_t>(model->nVertices()));
+        for (int i = 0; i < model->nVertices(); ++i)
+            screen[i] = transformMatrix.transform(model->get_vertex(i));
+    }
+
+    AllocStats::Scope stage(AllocStats::RASTER);
+    float xMax = framebuffer.get_width() - 1;
+    float yMax = framebuffer.get_height() - 1;
+    int drawn = 0;
+
+    for (const Edge &edge : edges) {
+        const Vec3f &v0 = screen[edge.v0];
+        const Vec3f &v1 = screen[edge.v1];
+
+        Vec2f p0(v0.x, v0.y), p1(v1.x, v1.y);
+        float t0, t1;
+        if (!clip_line(p0, p1, xMax, yMax, t0, t1))
+            continue;
+
+        if (depthTested) {
+            float dz = v1.z - v0.z;
+            line(Vec3f(p0.x, p0.y, v0.z + dz * t0), Vec3f(p1.x, p1.y, v0.z + dz * t1), framebuffer, color);
+        } else {
+            line(int(p0.x + .5f), int(p0.y + .5f), int(p1.x + .5f), int(p1.y + .5f), framebuffer, color);
+        }
+        drawn++;
+    }
+    return drawn;
+}
@@ -0,0 +1,27 @@
+//
+// Created by ju5t on 19.10.26.
+//
+
+#ifndef SIMPLESOFTWARERENDERER_WIREFRAME_H
+#define SIMPLESOFTWARERENDERER_WIREFRAME_H
+
+#include <vector>
+#include "Arena.h"
+#include "Framebuffer.h"
+#include "Model.h"
+#include "geometry.h"
+
+struct Edge {
+    int v0, v1;
+};
+
+// every edge of the model's faces once, edges shared by neighbouring faces are not repeated
+std::vector<Edge> unique_edges(Model *model);
+
+// Draws the edges transformed by transformMatrix, each vertex is transformed only once.
+// With depthTested the z-buffer must already hold the scene depth, hidden edges are skipped.
+// Returns how many edges survived clipping.
+int wireframe(Model *model, const std::vector<Edge> &edges, Matrix &transformMatrix, Framebuffer &framebuffer,
+              const TGAColor &color, bool depthTested, FrameArena &arena);
+
+#endif //SIMPLESOFTWARERENDERER_WIREFRAME_H
@@ -59,6 +59,19 @@ Matrix Matrix::operator*(const Matrix &a) {
     return result;
 }
 
+Vec3f Matrix::transform(const Vec3f &v) const {
+    assert(rows == 4 && cols == 4);
+    float r[4];
+    for (int i = 0; i < 4; ++i) {
+        r[i] = 0;
+        r[i] += m[i][0] * v.x;
+        r[i] += m[i][1] * v.y;
+        r[i] += m[i][2] * v.z;
+        r[i] += m[i][3] * 1.f;
+    }
+    return {r[0] / r[3], r[1] / r[3], r[2] / r[3]};
+}
+
 Matrix Matrix::transpose() {
     Matrix result(cols, rows);
 
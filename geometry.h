@@ -112,6 +112,9 @@ public:
 
     Matrix operator*(const Matrix &a);
 
+    // the same as Vec3f(*this * Matrix(v)) without the temporary matrices
+    Vec3f transform(const Vec3f &v) const;
+
     Matrix transpose();
 
     Matrix inverse();
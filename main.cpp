@@ -1,6 +1,35 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <limits>
-#include "TGAImage.h"
+#include <string>
+#include <sys/resource.h>
+#include "AllocStats.h"
+#include "Arena.h"
+#include "FrameBudget.h"
+#include "FrameSink.h"
+#include "FrameWriter.h"
+#include "ImageOps.h"
+#include "Instancing.h"
+#include "Lighting.h"
 #include "Model.h"
+#include "MeshStream.h"
+#include "PerfCounters.h"
+#include "Progressive.h"
+#include "Regression.h"
+#include "Renderer.h"
+#include "RetainedScene.h"
+#include "SceneGenerator.h"
+#include "Shading.h"
+#include "SortLast.h"
+#include "StreamingRenderer.h"
+#include "ThreadPool.h"
+#include "TGAImage.h"
+#include "Trace.h"
+#include "Wireframe.h"
 
 const TGAColor white = TGAColor(255, 255, 255);
 const TGAColor red = TGAColor(255, 0, 0);
@@ -9,196 +38,1079 @@ const TGAColor blue = TGAColor(0, 0, 255);
 
 static const int width = 850;
 static const int height = 850;
-static const int depth = 255;
 
-void line(int x0, int y0, int x1, int y1, TGAImage &image, const TGAColor &color) {
-    bool steep = false;
-    if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
-        std::swap(x0, y0);
-        std::swap(x1, y1);
-        steep = true;
+struct Options {
+    std::string modelFile = "../head.obj";
+    int frames = 1;
+    int writeBuffers = 2;
+    std::string sink = "tga";
+    std::string sinkPath = "-";
+    std::string wireframe = "off";
+    size_t streamChunkKb = 0;
+    size_t memLimitMb = 0;
+    std::string convert;
+    int workers = 1;
+    bool workersSweep = false;
+    std::string bench;
+    long long benchMax = 1000000;
+    std::string scene;
+    std::string generate;
+    std::string layout = "float";
+    std::string traceFile;
+    Framebuffer::Layout framebufferLayout = Framebuffer::LINEAR;
+    bool autoDepthRange = false;
+    int threads = 0;
+    int progressive = 0;
+    int lights = 0;
+    float lightRadius = .15f;
+    double budgetMs = 0;
+    bool budgetLod = false;
+    bool dolly = false;
+    int instances = 0;
+    int retained = 0;
+    std::string verifyDir;
+    bool updateGolden = false;
+    bool recordBudgets = false;
+    bool noBudgets = false;
+    int tolerance = 1;
+    double budgetSlack = .5;
+};
+
+static void usage(const char *program) {
+    std::cerr << "usage: " << program << " [--model file.obj] [--frames N] [--write-buffers N]\n"
+              << "       [--sink tga|bgr|rgb|bgra|ppm|y4m] [--sink-path file|-] [--wireframe off|plain|depth]\n"
+              << "       [--stream-chunk KB] [--mem-limit MB] [--convert file.ssm] [--workers N|sweep]\n"
+              << "       [--scene KIND:N] [--generate KIND:N]\n"
+              << "       [--bench shading|scaling|layout|tiling|post|lights|instances] [--bench-max N]\n"
+              << "       [--layout float|compact|quantized] [--trace trace.json]\n"
+              << "       [--framebuffer linear|tiled] [--depth-range fixed|auto] [--threads N]\n"
+              << "       [--progressive 2|4|8|16] [--lights N] [--light-radius R]\n"
+              << "       [--budget MS [--budget-lod]] [--dolly] [--instances N] [--retained N]\n"
+              << "       [--verify DIR [--update-golden] [--tolerance N] [--budget-slack X]\n"
+              << "                     [--record-budgets|--no-budgets]]\n";
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--update-golden") {
+            options.updateGolden = true;
+            continue;
+        }
+        if (arg == "--record-budgets") {
+            options.recordBudgets = true;
+            continue;
+        }
+        if (arg == "--no-budgets") {
+            options.noBudgets = true;
+            continue;
+        }
+        if (arg == "--budget-lod") {
+            options.budgetLod = true;
+            continue;
+        }
+        if (arg == "--dolly") {
+            options.dolly = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << '\n';
+            return false;
+        }
+        if (arg == "--model") {
+            options.modelFile = argv[++i];
+        } else if (arg == "--frames") {
+            options.frames = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--write-buffers") {
+            options.writeBuffers = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--sink") {
+            options.sink = argv[++i];
+        } else if (arg == "--sink-path") {
+            options.sinkPath = argv[++i];
+        } else if (arg == "--wireframe") {
+            options.wireframe = argv[++i];
+            if (options.wireframe != "off" && options.wireframe != "plain" && options.wireframe != "depth") {
+                std::cerr << "Unknown wireframe mode " << options.wireframe << '\n';
+                return false;
+            }
+        } else if (arg == "--stream-chunk") {
+            options.streamChunkKb = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--mem-limit") {
+            options.memLimitMb = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--convert") {
+            options.convert = argv[++i];
+        } else if (arg == "--bench") {
+            options.bench = argv[++i];
+            if (options.bench != "shading" && options.bench != "scaling" && options.bench != "layout" &&
+                options.bench != "tiling" && options.bench != "post" &&
+                options.bench != "lights" && options.bench != "instances") {
+                std::cerr << "Unknown benchmark " << options.bench << '\n';
+                return false;
+            }
+        } else if (arg == "--layout") {
+            options.layout = argv[++i];
+            if (options.layout != "float" && options.layout != "compact" && options.layout != "quantized") {
+                std::cerr << "Unknown layout " << options.layout << '\n';
+                return false;
+            }
+        } else if (arg == "--framebuffer") {
+            std::string value = argv[++i];
+            if (value != "linear" && value != "tiled") {
+                std::cerr << "Unknown framebuffer layout " << value << '\n';
+                return false;
+            }
+            options.framebufferLayout = value == "tiled" ? Framebuffer::TILED : Framebuffer::LINEAR;
+        } else if (arg == "--depth-range") {
+            std::string value = argv[++i];
+            if (value != "fixed" && value != "auto") {
+                std::cerr << "Unknown depth range " << value << '\n';
+                return false;
+            }
+            options.autoDepthRange = value == "auto";
+        } else if (arg == "--progressive") {
+            options.progressive = std::atoi(argv[++i]);
+            if (options.progressive < 2 || options.progressive > 16 ||
+                (options.progressive & (options.progressive - 1))) {
+                std::cerr << "The coarsest progressive pass must be 1/2, 1/4, 1/8 or 1/16\n";
+                return false;
+            }
+        } else if (arg == "--lights") {
+            options.lights = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--light-radius") {
+            options.lightRadius = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--budget") {
+            options.budgetMs = std::max(0., std::atof(argv[++i]));
+        } else if (arg == "--instances") {
+            options.instances = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--retained") {
+            options.retained = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--threads") {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--trace") {
+            options.traceFile = argv[++i];
+        } else if (arg == "--bench-max") {
+            options.benchMax = std::max(1LL, std::atoll(argv[++i]));
+        } else if (arg == "--scene" || arg == "--generate") {
+            SceneSpec spec;
+            (arg == "--scene" ? options.scene : options.generate) = argv[++i];
+            if (!parse_scene(argv[i], spec))
+                return false;
+        } else if (arg == "--verify") {
+            options.verifyDir = argv[++i];
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--budget-slack") {
+            options.budgetSlack = std::max(0., std::atof(argv[++i]));
+        } else if (arg == "--workers") {
+            std::string value = argv[++i];
+            options.workersSweep = value == "sweep";
+            options.workers = options.workersSweep ? 1 : std::max(1, std::atoi(value.c_str()));
+        } else {
+            std::cerr << "Unknown option " << arg << '\n';
+            return false;
+        }
     }
+    return true;
+}
+
+static Matrix rotationY(float angle) {
+    Matrix m = Matrix::identity();
+    m[0][0] = std::cos(angle);
+    m[0][2] = std::sin(angle);
+    m[2][0] = -std::sin(angle);
+    m[2][2] = std::cos(angle);
+    return m;
+}
+
+// --dolly: the camera moves in to 60% of its distance and back over the frames, so the screen coverage changes
+static Vec3f dolly_eye(int frame, int frames) {
+    float s = std::sin(float(M_PI) * frame / frames);
+    return Vec3f(1, 0, 3) * (1 - .4f * s * s);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
-    if (x0 > x1) {
-        std::swap(x0, x1);
-        std::swap(y0, y1);
+// sort-last speedup over the single process renderer for 2..32 workers, checking the images are identical
+static int sort_last_sweep(Model *model, Matrix &transformMatrix, const Vec3f &lightDirection) {
+    Framebuffer reference(width, height);
+    FrameArena arena;
+    auto start = std::chrono::steady_clock::now();
+    render(model, transformMatrix, lightDirection, reference, arena);
+    double single = seconds_since(start);
+    std::cerr << "# sort-last 1 worker: " << single << "s" << std::endl;
+
+    size_t colorBytes = static_cast<size_t>(width) * height * reference.color.get_bytesPerPixel();
+    bool identical = true;
+    for (int nWorkers = 2; nWorkers <= 32; nWorkers *= 2) {
+        Framebuffer framebuffer(width, height);
+        SortLastStats stats{};
+        if (!render_sort_last(model, transformMatrix, lightDirection, framebuffer, nWorkers, stats))
+            return 1;
+
+        bool same = !memcmp(framebuffer.color.buffer(), reference.color.buffer(), colorBytes) &&
+                    framebuffer.zBuffer == reference.zBuffer;
+        identical = identical && same;
+        std::cerr << "# sort-last " << nWorkers << " workers: " << stats.totalSeconds << "s, speedup "
+                  << single / stats.totalSeconds << ", render " << stats.renderSeconds << "s, compositing "
+                  << stats.compositeSeconds << "s (" << 100 * stats.compositeSeconds / stats.totalSeconds
+                  << "%)" << (same ? "" : ", OUTPUT DIFFERS") << std::endl;
     }
+    return identical ? 0 : 1;
+}
 
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int derror = std::abs(dy) * 2;
-    int error = 0;
-    int y = y0;
+// fragment shading throughput: float TGAColor::operator*(float) against the fixed-point kernels
+static int bench_shading() {
+    const int n = 1 << 20;
+    const int repeats = 16;
+    std::vector<uint32_t> texels(n), fixedScalar(n), fixedSimd(n), floating(n);
+    std::vector<float> intensities(n);
+    uint32_t seed = 12345;
+    for (int i = 0; i < n; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        texels[i] = seed;
+        intensities[i] = float(seed >> 8 & 0xffff) / 0xffff * 1.2f - .1f;   // includes values to clamp
+    }
 
-    for (int x = x0; x <= x1; x++) {
-        if (steep) {
-            image.set(y, x, color);
-        } else {
-            image.set(x, y, color);
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (int i = 0; i < n; ++i) {
+            TGAColor color = TGAColor(reinterpret_cast<const uint8_t *>(&texels[i]), 4) * intensities[i];
+            memcpy(&floating[i], color.bgra, 4);
         }
-        error += derror;
+    }
+    double floatSeconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        shade_fragments_scalar(texels.data(), intensities.data(), fixedScalar.data(), n);
+    double scalarSeconds = seconds_since(start);
 
-        if (error > dx) {
-            y += (y1 > y0 ? 1 : -1);
-            error -= dx * 2;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        shade_fragments(texels.data(), intensities.data(), fixedSimd.data(), n);
+    double simdSeconds = seconds_since(start);
+
+    int maxDiff = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            int a = floating[i] >> (8 * c) & 0xff;
+            int b = fixedSimd[i] >> (8 * c) & 0xff;
+            maxDiff = std::max(maxDiff, std::abs(a - b));
         }
     }
-}
+    bool bitExact = fixedScalar == fixedSimd;
 
-void line(const Vec2i &vec1, const Vec2i &vec2, TGAImage &image, const TGAColor &color) {
-    line(vec1.x, vec1.y, vec2.x, vec2.y, image, color);
+    double fragments = double(n) * repeats / 1e6;
+    std::cerr << "# shading float:  " << fragments / floatSeconds << " Mfragments/s" << std::endl;
+    std::cerr << "# shading scalar: " << fragments / scalarSeconds << " Mfragments/s" << std::endl;
+    std::cerr << "# shading " << shading_isa() << ":   " << fragments / simdSeconds << " Mfragments/s, "
+              << floatSeconds / simdSeconds << "x float" << std::endl;
+    std::cerr << "# max difference to float " << maxDiff << " LSB, " << shading_isa()
+              << (bitExact ? " bit-exact" : " DIFFERS") << " with scalar" << std::endl;
+    return maxDiff <= 1 && bitExact ? 0 : 1;
 }
 
-void triangle(Vec3i t[], Vec2i uv[], float ity[], Model *model, TGAImage &image, int zBuffer[]) {
-    if (t[0].y == t[1].y && t[0].y == t[2].y)
-        return;
+// time of every pipeline stage against triangle count, covered pixels and depth complexity of the generated
+// scenes, as CSV on stdout
+static int bench_scaling(long long maxTriangles) {
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Framebuffer framebuffer(width, height);
+    FrameArena arena;
+
+    std::cout << "scene,triangles,covered_pixels,depth_complexity,generate_s,vertex_s,raster_s,flip_s,encode_s"
+              << std::endl;
+    for (int kind = 0; kind < N_SCENE_KINDS; ++kind) {
+        for (long long triangles = 1000; triangles <= maxTriangles; triangles *= 10) {
+            SceneSpec spec{static_cast<SceneKind>(kind), triangles};
+            auto start = std::chrono::steady_clock::now();
+            Model *model = generate_model(spec);
+            double generateSeconds = seconds_since(start);
+
+            // an empty face range runs the vertex stage only
+            framebuffer.clear();
+            arena.reset();
+            start = std::chrono::steady_clock::now();
+            render(model, transformMatrix, lightDirection, framebuffer, arena, 0, 0);
+            double vertexSeconds = seconds_since(start);
+
+            arena.reset();
+            start = std::chrono::steady_clock::now();
+            long long fragments = render(model, transformMatrix, lightDirection, framebuffer, arena);
+            double rasterSeconds = std::max(0., seconds_since(start) - vertexSeconds);
+
+            long long covered = std::count_if(framebuffer.zBuffer.begin(), framebuffer.zBuffer.end(),
+                                              [](int z) { return z != std::numeric_limits<int>::min(); });
 
-    if (t[0].y > t[1].y) {
-        std::swap(t[0], t[1]);
-        std::swap(uv[0], uv[1]);
-        std::swap(ity[0], ity[1]);
+            start = std::chrono::steady_clock::now();
+            framebuffer.color.flip_vertically();
+            double flipSeconds = seconds_since(start);
+
+            start = std::chrono::steady_clock::now();
+            framebuffer.color.write_tga_file("/dev/null");
+            double encodeSeconds = seconds_since(start);
+
+            std::cout << scene_name(spec.kind) << ',' << model->nFaces() << ',' << covered << ','
+                      << (covered ? double(fragments) / covered : 0.) << ',' << generateSeconds << ','
+                      << vertexSeconds << ',' << rasterSeconds << ',' << flipSeconds << ',' << encodeSeconds
+                      << std::endl;
+            delete model;
+        }
     }
-    if (t[0].y > t[2].y) {
-        std::swap(t[0], t[2]);
-        std::swap(uv[0], uv[2]);
-        std::swap(ity[0], ity[2]);
+    return 0;
+}
+
+static Model *load_model(const Options &options, const std::string &layout) {
+    Trace::Span span("model load");
+    SceneSpec spec;
+    Model *model = !options.scene.empty() && parse_scene(options.scene, spec) ? generate_model(spec)
+                                                                             : new Model(options.modelFile.c_str());
+    if (layout != "float")
+        model->compact(layout == "quantized");
+    return model;
+}
+
+// attribute memory and vertex stage throughput of the float layout against the compact ones
+static int bench_layout(const Options &options) {
+    const int runs = 9;
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Framebuffer reference(width, height), framebuffer(width, height);
+    FrameArena arena;
+
+    const char *layouts[3] = {"float", "compact", "quantized"};
+    for (const char *layout : layouts) {
+        Model *model = load_model(options, layout);
+        std::vector<double> vertexSeconds;
+        for (int run = 0; run < runs; ++run) {
+            arena.reset();
+            auto start = std::chrono::steady_clock::now();
+            render(model, transformMatrix, lightDirection, framebuffer, arena, 0, 0);
+            vertexSeconds.push_back(seconds_since(start));
+        }
+        std::sort(vertexSeconds.begin(), vertexSeconds.end());
+
+        Framebuffer &target = layout == layouts[0] ? reference : framebuffer;
+        target.clear();
+        arena.reset();
+        auto start = std::chrono::steady_clock::now();
+        render(model, transformMatrix, lightDirection, target, arena);
+        double renderSeconds = seconds_since(start);
+
+        // quantization moves triangle edges and uv rounding at texel borders, count what changed beyond 1 LSB
+        ImageDiff diff = compare_images(target.color, reference.color, 1);
+
+        double vertices = model->nVertices() + model->nNormals();
+        std::cerr << "# layout " << layout << ": " << model->attribute_bytes() / 1024. << " KB attributes, "
+                  << "vertex stage " << vertices / vertexSeconds[runs / 2] / 1e6 << " Mattributes/s, render " << renderSeconds
+                  << "s, " << 100. * diff.differingPixels / (width * height) << "% pixels differ from float (max "
+                  << diff.maxDifference << ")" << std::endl;
+        delete model;
     }
-    if (t[1].y > t[2].y) {
-        std::swap(t[1], t[2]);
-        std::swap(uv[1], uv[2]);
-        std::swap(ity[1], ity[2]);
+    return 0;
+}
+
+// raster and detile time and cache/TLB misses of the linear against the tiled framebuffer on the generated scenes
+static int bench_tiling(long long maxTriangles) {
+    const int runs = 3;
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    FrameArena arena;
+    PerfCounters counters;
+    if (!counters.is_available())
+        std::cerr << "# hardware counters are not available, reporting times only" << std::endl;
+
+    bool identical = true;
+    for (int kind = 0; kind < N_SCENE_KINDS; ++kind) {
+        SceneSpec spec{static_cast<SceneKind>(kind), std::min(maxTriangles, 100000LL)};
+        Model *model = generate_model(spec);
+        Framebuffer linear(width, height), tiled(width, height, TGAImage::RGB, Framebuffer::TILED);
+        TGAImage linearDepth(width, height, TGAImage::GRAYSCALE), tiledDepth(width, height, TGAImage::GRAYSCALE);
+
+        for (Framebuffer *framebuffer : {&linear, &tiled}) {
+            std::vector<double> rasterSeconds;
+            for (int run = 0; run < runs; ++run) {
+                framebuffer->clear();
+                arena.reset();
+                if (run == runs - 1)
+                    counters.start();
+                auto start = std::chrono::steady_clock::now();
+                render(model, transformMatrix, lightDirection, *framebuffer, arena);
+                rasterSeconds.push_back(seconds_since(start));
+                if (run == runs - 1)
+                    counters.stop();
+            }
+            std::sort(rasterSeconds.begin(), rasterSeconds.end());
+
+            auto start = std::chrono::steady_clock::now();
+            framebuffer->resolve();
+            double detileSeconds = seconds_since(start);
+
+            std::cerr << "# tiling " << scene_name(spec.kind) << ' '
+                      << (framebuffer == &linear ? "linear" : "tiled ") << ": render " << rasterSeconds[runs / 2]
+                      << "s, detile " << detileSeconds << 's';
+            for (int c = 0; c < PerfCounters::N_COUNTERS; ++c) {
+                auto counter = static_cast<PerfCounters::Counter>(c);
+                if (counters.get(counter) >= 0)
+                    std::cerr << ", " << PerfCounters::name(counter) << ' ' << counters.get(counter);
+            }
+            std::cerr << std::endl;
+        }
+
+        linear.depth_image(linearDepth);
+        tiled.depth_image(tiledDepth);
+        bool same = !compare_images(linear.color, tiled.color, 0).differingPixels &&
+                    !compare_images(linearDepth, tiledDepth, 0).differingPixels;
+        if (!same)
+            std::cerr << "# tiling " << scene_name(spec.kind) << ": OUTPUT DIFFERS" << std::endl;
+        identical = identical && same;
+        delete model;
     }
+    return identical ? 0 : 1;
+}
 
-    int total_height = t[2].y - t[0].y;
-    for (int i = 0; i < total_height; i++) {
-        bool isSecondHalf = i > t[1].y - t[0].y || t[1].y == t[0].y;
-        int segment_height = isSecondHalf ? t[2].y - t[1].y : t[1].y - t[0].y;
+// what post-processing cost before the kernels: per-pixel get/set, the depth image walked column by column
+static void legacy_flip_horizontally(TGAImage &image) {
+    for (int i = 0; i < image.get_width() / 2; i++) {
+        for (int j = 0; j < image.get_height(); j++) {
+            TGAColor c1 = image.get(i, j);
+            TGAColor c2 = image.get(image.get_width() - 1 - i, j);
+            image.set(i, j, c2);
+            image.set(image.get_width() - 1 - i, j, c1);
+        }
+    }
+}
 
-        float alpha = float(i) / total_height;
-        float beta = float(i - (isSecondHalf ? t[1].y - t[0].y : 0)) / segment_height;
+static void legacy_depth_image(const Framebuffer &framebuffer, TGAImage &image) {
+    for (int i = 0; i < framebuffer.get_width(); ++i) {
+        for (int j = 0; j < framebuffer.get_height(); ++j)
+            image.set(i, j, TGAColor(static_cast<uint8_t>(framebuffer.zBuffer[i + j * framebuffer.get_width()])));
+    }
+}
 
-        Vec3i A = t[0] + Vec3f(t[2] - t[0]) * alpha;
-        Vec3i B = isSecondHalf ? t[1] + Vec3f(t[2] - t[1]) * beta : t[0] + Vec3f(t[1] - t[0]) * beta;
+// post-processing kernels on a 4K frame against its rasterization, serial and on the pool
+static int bench_post(const Options &options) {
+    const int32_t w = 3840, h = 2160;
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), w, h);
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Model *model = load_model(options, options.layout);
+    Framebuffer framebuffer(w, h);
+    FrameArena arena;
+    auto start = std::chrono::steady_clock::now();
+    render(model, transformMatrix, lightDirection, framebuffer, arena);
+    double rasterSeconds = seconds_since(start);
+    delete model;
+    std::cerr << "# post 4K raster: " << rasterSeconds << "s" << std::endl;
 
-        Vec2i uvA = uv[0] + (uv[2] - uv[0]) * alpha;
-        Vec2i uvB = isSecondHalf ? uv[1] + (uv[2] - uv[1]) * beta : uv[0] + (uv[1] - uv[0]) * beta;
+    TGAImage depth(w, h, TGAImage::GRAYSCALE), rgba(w, h, TGAImage::RGBA), gray(w, h, TGAImage::GRAYSCALE);
+    TGAImage half(w / 2, h / 2, TGAImage::RGB), full(w, h, TGAImage::RGB);
 
-        float ityA = ity[0] + (ity[2] - ity[0]) * alpha;
-        float ityB = isSecondHalf ? ity[1] + (ity[2] - ity[1]) * beta : ity[0] + (ity[1] - ity[0]) * beta;
+    start = std::chrono::steady_clock::now();
+    legacy_flip_horizontally(framebuffer.color);
+    double legacyFlip = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    legacy_depth_image(framebuffer, depth);
+    double legacyDepth = seconds_since(start);
+    std::cerr << "# post legacy flip_horizontally " << legacyFlip << "s, depth image " << legacyDepth << "s"
+              << std::endl;
 
-        if (A.x > B.x) {
-            std::swap(A, B);
-            std::swap(uvA, uvB);
-            std::swap(ityA, ityB);
+    std::vector<int> sizes = {1};
+    if (ThreadPool::instance().size() > 1)
+        sizes.push_back(ThreadPool::instance().size());
+    for (int nThreads : sizes) {
+        ThreadPool pool(nThreads);
+        struct Kernel {
+            const char *name;
+            std::function<void()> run;
+        };
+        std::vector<Kernel> kernels = {
+                {"flip_vertically",   [&] { flip_vertically(framebuffer.color, pool); }},
+                {"flip_horizontally", [&] { flip_horizontally(framebuffer.color, pool); }},
+                {"depth fixed",       [&] { framebuffer.depth_image(depth); }},
+                {"depth auto",        [&] { framebuffer.depth_image(depth, true); }},
+                {"RGB to RGBA",       [&] { convert_format(framebuffer.color, rgba, pool); }},
+                {"RGBA to gray",      [&] { convert_format(rgba, gray, pool); }},
+                {"area 4K to 1080p",  [&] { resize_area(framebuffer.color, half, pool); }},
+                {"bilinear to 4K",    [&] { resize_bilinear(half, full, pool); }},
+        };
+        double total = 0;
+        for (const Kernel &kernel : kernels) {
+            start = std::chrono::steady_clock::now();
+            kernel.run();
+            double seconds = seconds_since(start);
+            total += seconds;
+            std::cerr << "# post " << nThreads << " threads " << kernel.name << ": " << seconds << "s" << std::endl;
         }
+        std::cerr << "# post " << nThreads << " threads total " << total << "s, " << 100 * total / rasterSeconds
+                  << "% of the raster time" << std::endl;
+    }
+    return 0;
+}
 
-        for (int x = A.x; x <= B.x; x++) {
-            float phi = A.x == B.x ? 1.f : float(x - A.x) / (B.x - A.x);
+// many-light shading from 1 to 1000 lights: tiled culling against every light at every pixel
+static int bench_lights(const Options &options) {
+    const int runs = 3;
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    Model *model = load_model(options, options.layout);
+    Framebuffer tiled(width, height, TGAImage::RGB, options.framebufferLayout);
+    Framebuffer brute(width, height, TGAImage::RGB, options.framebufferLayout);
+    TiledLighting lighting(width, height);
+    FrameArena arena;
 
-            Vec3i P = Vec3f(A) + Vec3f(B - A) * phi;
-            Vec2i uvP = uvA + (uvB - uvA) * phi;
-            float ityP = ityA + (ityB - ityA) * phi;
+    bool identical = true;
+    std::cout << "lights,frame_s,gbuffer_s,cull_s,shade_s,lights_per_tile,evaluations_per_pixel,all_lights_s,"
+              << "identical" << std::endl;
+    for (int n : {1, 3, 10, 30, 100, 300, 1000}) {
+        LightList lights;
+        lights.set_directional(Vec3f(1, 0, 3).normalize(), Vec3f(.3f, .3f, .3f));
+        scatter_lights(*model, n, options.lightRadius, lights);
 
-            int idx = P.x + P.y * width;
-            if (zBuffer[idx] < P.z) {
-                zBuffer[idx] = P.z;
-                TGAColor color = model->get_diffuse(uvP) * ityP;
-//                TGAColor color = TGAColor(255, 255, 255) * ityP;
-                image.set(P.x, P.y, color);
-            }
+        std::vector<TiledLighting::Stats> stats;
+        for (int run = 0; run < runs; ++run) {
+            tiled.clear();
+            arena.reset();
+            stats.push_back(lighting.render(model, transformMatrix, lights, tiled, arena));
         }
+        auto total = [](const TiledLighting::Stats &s) { return s.gbufferSeconds + s.cullSeconds + s.shadeSeconds; };
+        std::sort(stats.begin(), stats.end(), [&](const TiledLighting::Stats &a, const TiledLighting::Stats &b) {
+            return total(a) < total(b);
+        });
+        const TiledLighting::Stats &median = stats[runs / 2];
+
+        brute.clear();
+        arena.reset();
+        TiledLighting::Stats all = lighting.render(model, transformMatrix, lights, brute, arena, false);
+        tiled.resolve();
+        brute.resolve();
+        bool same = !compare_images(tiled.color, brute.color, 0).differingPixels;
+        identical = identical && same;
+
+        long long covered = std::count_if(tiled.zBuffer.begin(), tiled.zBuffer.end(),
+                                          [](int z) { return z != std::numeric_limits<int>::min(); });
+        std::cout << n << ',' << total(median) << ','
+                  << median.gbufferSeconds << ',' << median.cullSeconds << ',' << median.shadeSeconds << ','
+                  << median.lightsPerTile << ',' << (covered ? double(median.lightEvaluations) / covered : 0.) << ','
+                  << all.gbufferSeconds + all.shadeSeconds << ',' << (same ? "yes" : "no") << std::endl;
     }
+    delete model;
+    return identical ? 0 : 1;
 }
 
-Matrix getViewport(int x, int y, int w, int h) {
-    Matrix m = Matrix::identity(4);
-    m[0][3] = x + w / 2.f;
-    m[1][3] = y + h / 2.f;
-    m[2][3] = depth / 2.f;
+// the instance turned around the vertical axis through its origin
+static Instance turned(const Instance &instance, float degrees) {
+    const float angle = degrees * float(M_PI) / 180;
+    const float c = std::cos(angle), s = std::sin(angle);
+    Instance result = instance;
+    for (int k = 0; k < 3; ++k) {
+        result.transform[0][k] = c * instance.transform[0][k] + s * instance.transform[2][k];
+        result.transform[2][k] = -s * instance.transform[0][k] + c * instance.transform[2][k];
+    }
+    return result;
+}
+
+// per-frame costs of a retained editing session by kind of change, and the final frame against a redraw of the
+// whole scene from scratch
+static void report_retained(const RetainedScene &scene, const std::vector<RetainedScene::Stats> &stats,
+                            Model *model) {
+    const char *kinds[3] = {"full", "object", "light"};
+    double seconds[3] = {}, tiles[3] = {}, rows[3] = {};
+    int counts[3] = {};
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const RetainedScene::Stats &s = stats[i];
+        int kind = i == 0 ? 0 : s.reshaded ? 2 : 1;
+        std::cerr << "# retained frame " << i << ": " << kinds[kind] << ", " << s.dirtyTiles << " dirty tiles, "
+                  << s.changedRows << " rows changed, " << s.fragments << " fragments, draw " << s.drawSeconds * 1000
+                  << "ms, reshade " << s.reshadeSeconds * 1000 << "ms" << std::endl;
+        seconds[kind] += s.drawSeconds + s.reshadeSeconds;
+        tiles[kind] += s.dirtyTiles;
+        rows[kind] += s.changedRows;
+        counts[kind]++;
+    }
+    for (int kind = 0; kind < 3; ++kind) {
+        if (counts[kind])
+            std::cerr << "# retained " << kinds[kind] << " frames: " << counts[kind] << ", mean "
+                      << seconds[kind] / counts[kind] * 1000 << "ms, " << tiles[kind] / counts[kind]
+                      << " dirty tiles, " << rows[kind] / counts[kind] << " rows changed" << std::endl;
+    }
+
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    RetainedScene redraw(transformMatrix, width, height);
+    for (int id = 0; id < scene.size(); ++id)
+        redraw.add_object(model, scene.get_placement(id));
+    redraw.set_light(scene.get_light());
+    RetainedScene::Stats full = redraw.update();
+    ImageDiff diff = compare_images(scene.get_framebuffer().color, redraw.get_framebuffer().color, 0);
+    bool sameDepth = scene.get_framebuffer().zBuffer == redraw.get_framebuffer().zBuffer;
+    std::cerr << "# retained redraw from scratch " << (full.drawSeconds + full.reshadeSeconds) * 1000
+              << "ms; last frame differs in " << diff.differingPixels << " pixels, depth "
+              << (sameDepth ? "identical" : "DIFFERS") << std::endl;
+}
 
-    m[0][0] = w / 2.f;
-    m[1][1] = h / 2.f;
-    m[2][2] = depth / 2.f;
+// the affine instance transform as a 4x4 matrix for the per-copy render() loop
+static Matrix instance_matrix(const Instance &instance) {
+    Matrix m = Matrix::identity(4);
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            m[r][c] = instance.transform[r][c];
     return m;
 }
 
-Matrix lookat(Vec3f eye, Vec3f center, Vec3f up) {
-    Vec3f z = (eye - center).normalize();
-    Vec3f x = (up ^ z).normalize();
-    Vec3f y = (z ^ x).normalize();
-    Matrix res = Matrix::identity();
-    for (int i = 0; i < 3; ++i) {
-        res[0][i] = x[i];
-        res[1][i] = y[i];
-        res[2][i] = z[i];
-        res[i][3] = -center[i];
+// instanced copies of the model over a fixed area from 1 to 10000 instances, against rendering every copy with
+// render() and the light moved into its model space
+static int bench_instances(const Options &options) {
+    const int runs = 3;
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
+    Model *model = load_model(options, options.layout);
+    Framebuffer framebuffer(width, height, TGAImage::RGB, options.framebufferLayout);
+    InstancedRenderer renderer(model);
+    FrameArena arena;
+
+    std::cout << "instances,drawn,culled,frame_s,instances_per_s,fragments,scratch_kb,per_copy_s,"
+              << "per_copy_instances_per_s" << std::endl;
+    for (int n : {1, 10, 100, 1000, 10000}) {
+        std::vector<Instance> instances;
+        instance_grid(*model, n, 1.6f, instances);
+
+        std::vector<InstancedRenderer::Stats> stats;
+        for (int run = 0; run < runs; ++run) {
+            framebuffer.clear();
+            stats.push_back(renderer.render(instances, transformMatrix, lightDirection, framebuffer));
+        }
+        std::sort(stats.begin(), stats.end(), [](const InstancedRenderer::Stats &a,
+                                                 const InstancedRenderer::Stats &b) {
+            return a.seconds < b.seconds;
+        });
+        const InstancedRenderer::Stats &median = stats[runs / 2];
+
+        framebuffer.clear();
+        auto start = std::chrono::steady_clock::now();
+        for (const Instance &instance : instances) {
+            Matrix instanceTransform = transformMatrix * instance_matrix(instance);
+            Matrix inverse = instance_matrix(instance).transpose();
+            Vec3f light = Vec3f(inverse * Matrix(lightDirection)).normalize();
+            arena.reset();
+            render(model, instanceTransform, light, framebuffer, arena);
+        }
+        double perCopy = seconds_since(start);
+
+        std::cout << n << ',' << median.drawn << ',' << median.culled << ',' << median.seconds << ','
+                  << n / median.seconds << ',' << median.fragments << ',' << (renderer.scratch_bytes() >> 10) << ','
+                  << perCopy << ',' << n / perCopy << std::endl;
     }
-    return res;
+    delete model;
+    return 0;
 }
 
-int main() {
-    auto *model = new Model("../head.obj");
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    Trace::set_thread_name("main");
+    if (options.threads)
+        ThreadPool::set_default_threads(options.threads);
+    if (!options.traceFile.empty())
+        Trace::enable();
+
+    if (options.bench == "shading")
+        return bench_shading();
+    if (options.bench == "scaling")
+        return bench_scaling(options.benchMax);
+    if (options.bench == "layout")
+        return bench_layout(options);
+    if (options.bench == "tiling")
+        return bench_tiling(options.benchMax);
+    if (options.bench == "post")
+        return bench_post(options);
+    if (options.bench == "lights")
+        return bench_lights(options);
+    if (options.bench == "instances")
+        return bench_instances(options);
 
-    auto *zBuffer = new int[width * height];
-    for (int i = 0; i < width * height; ++i) {
-        zBuffer[i] = std::numeric_limits<int>::min();
+    if (!options.generate.empty()) {
+        SceneSpec spec;
+        parse_scene(options.generate, spec);
+        return write_scene_obj(spec, std::string("scene_") + scene_name(spec.kind) + "_" +
+                                     std::to_string(spec.triangles) + ".obj") ? 0 : 1;
     }
 
-    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
-    Vec3f eyePosition(1, 0, 3);
-    Vec3f center(0, 0, 0);
+    if (!options.verifyDir.empty()) {
+        VerifyOptions verify{options.verifyDir, options.modelFile, options.updateGolden, options.recordBudgets,
+                             !options.noBudgets, options.tolerance, options.budgetSlack, width, height,
+                             options.framebufferLayout};
+        return run_verify(verify) ? 1 : 0;
+    }
+
+    if (!options.convert.empty()) {
+        std::unique_ptr<ChunkReader> reader = open_chunk_reader(options.modelFile);
+        return reader->is_open() && write_chunked_mesh(*reader, options.convert) ? 0 : 1;
+    }
+
+    // progressive frames are written once per pass
+    int imagesPerFrame = 1;
+    for (int scale = options.progressive; scale > 1; scale /= 2)
+        imagesPerFrame++;
+    std::unique_ptr<FrameSink> sink = make_sink(options.sink, options.sinkPath, width, height,
+                                                options.frames * imagesPerFrame, options.autoDepthRange);
+    if (!sink)
+        return 1;
+
+    // the streaming mode never loads the whole mesh, it reads it chunk by chunk every frame
+    bool streaming = options.streamChunkKb > 0;
+    Model *model = nullptr;
+    std::unique_ptr<ChunkReader> reader;
+    std::unique_ptr<StreamingRenderer> streamer;
+    if (streaming) {
+        if (!options.scene.empty()) {
+            std::cerr << "Streaming reads the mesh from disk, write the scene with --generate first\n";
+            return 1;
+        }
+        if (options.wireframe != "off") {
+            std::cerr << "Wireframe mode needs the whole mesh, it can't be streamed\n";
+            return 1;
+        }
+        size_t chunkBytes = options.streamChunkKb << 10;
+        if (options.memLimitMb) {
+            // everything but the two chunk buffers is fixed: the framebuffer ring and the z-buffer image
+            size_t limit = options.memLimitMb << 20;
+            size_t fixed = static_cast<size_t>(width) * height *
+                           ((TGAImage::RGB + sizeof(int)) * options.writeBuffers + TGAImage::GRAYSCALE);
+            if (limit <= fixed) {
+                std::cerr << "Memory limit is below the " << (fixed >> 20) << " MB the framebuffers need\n";
+                return 1;
+            }
+            chunkBytes = std::min(chunkBytes, (limit - fixed) / 2);
+        }
 
-    //Image
-    TGAImage image(width, height, TGAImage::RGB);
+        AllocStats::Scope stage(AllocStats::LOAD);
+        reader = open_chunk_reader(options.modelFile);
+        if (!reader->is_open())
+            return 1;
+        streamer.reset(new StreamingRenderer(*reader, chunkBytes));
+    } else {
+        AllocStats::Scope stage(AllocStats::LOAD);
+        model = load_model(options, options.layout);
+    }
+    StreamingRenderer::Stats streamStats{};
+    SortLastStats sortLastStats{};
+    if (model && options.workers > 1 && options.wireframe != "off") {
+        std::cerr << "Sort-last rendering does not support wireframe mode\n";
+        return 1;
+    }
+    if (streaming && (options.workers > 1 || options.workersSweep)) {
+        std::cerr << "Sort-last rendering needs the whole mesh, it can't be streamed\n";
+        return 1;
+    }
+    if (options.lights && (streaming || options.workers > 1 || options.wireframe != "off" || options.progressive)) {
+        std::cerr << "Point and spot lights need the deferred renderer, which works on its own only\n";
+        return 1;
+    }
+    bool budgeted = options.budgetMs > 0;
+    if (budgeted && (streaming || options.workers > 1 || options.wireframe != "off" || options.progressive ||
+                     options.lights)) {
+        std::cerr << "The frame budget scales the shaded single-threaded renderer only\n";
+        return 1;
+    }
+    if (options.instances && (streaming || options.workers > 1 || options.wireframe != "off" || options.progressive ||
+                              options.lights || budgeted)) {
+        std::cerr << "Instanced copies are drawn by the instanced renderer, which works on its own only\n";
+        return 1;
+    }
+    if (options.retained && (streaming || options.workers > 1 || options.wireframe != "off" || options.progressive ||
+                             options.lights || budgeted || options.instances)) {
+        std::cerr << "The retained scene is drawn by its own renderer, which works on its own only\n";
+        return 1;
+    }
+    if (options.progressive && (streaming || options.workers > 1 || options.wireframe != "off")) {
+        std::cerr << "Progressive rendering works with the shaded single-threaded renderer only\n";
+        return 1;
+    }
+    std::unique_ptr<ProgressiveRenderer> progressive;
+    if (options.progressive)
+        progressive.reset(new ProgressiveRenderer(model, width, height, options.progressive,
+                                                  options.framebufferLayout));
+    ProgressiveRenderer::Stats progressiveStats{};
+    TGAImage progressiveFinal;
 
-    Matrix modelView = lookat(eyePosition, center, Vec3f(0, 1, 0));
-    Matrix projection = Matrix::identity();
-    projection[3][2] = -1.f / (eyePosition - center).z;
-    Matrix viewport = getViewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    // frames drawn at the budget's scale into internal, then stretched to the output size
+    std::unique_ptr<FrameBudget> budget;
+    std::unique_ptr<Framebuffer> internal;
+    std::vector<std::unique_ptr<Model>> budgetLods;
+    if (budgeted) {
+        if (options.budgetLod) {
+            for (int gridCells = 96; gridCells >= 24; gridCells /= 2) {
+                std::vector<int> sourceFaces;
+                budgetLods.emplace_back(model->clustered(gridCells, sourceFaces));
+                std::cerr << "# budget LOD " << budgetLods.size() << ": " << budgetLods.back()->nFaces() << " of "
+                          << model->nFaces() << " faces" << std::endl;
+            }
+        }
+        budget.reset(new FrameBudget(options.budgetMs / 1000, .25f, static_cast<int>(budgetLods.size())));
+    }
 
-    Matrix transformMatrix = viewport * projection * modelView;
+    Vec3f lightDirection = Vec3f(1, 0, 3).normalize();
+    Matrix transformMatrix = camera_transform(Vec3f(1, 0, 3), Vec3f(0, 0, 0), width, height);
 
-    std::cerr << modelView << std::endl;
-    std::cerr << projection << std::endl;
-    std::cerr << viewport << std::endl;
     std::cerr << transformMatrix << std::endl;
 
-    for (int iFace = 0; iFace < model->nFaces(); ++iFace) {
-        std::vector<int> face = model->get_face(iFace);
-        Vec3f world_c[3];
-        Vec3i screen_c[3];
-        Vec2i uv[3];
-        float intensity[3];
+    LightList lights;
+    std::unique_ptr<TiledLighting> lighting;
+    TiledLighting::Stats lightingStats{};
+    if (options.lights) {
+        // the directional light stays as a dim fill
+        lights.set_directional(lightDirection, Vec3f(.3f, .3f, .3f));
+        scatter_lights(*model, options.lights, options.lightRadius, lights);
+        lighting.reset(new TiledLighting(width, height));
+    }
+
+    std::vector<Instance> instances;
+    std::unique_ptr<InstancedRenderer> instanced;
+    InstancedRenderer::Stats instancedStats{};
+    if (options.instances) {
+        instance_grid(*model, options.instances, 1.6f, instances);
+        instanced.reset(new InstancedRenderer(model));
+    }
 
-        for (int jVertex = 0; jVertex < 3; ++jVertex) {
-            Vec3f vertex = model->get_vertex(face[jVertex]);
-            screen_c[jVertex] = Vec3f(transformMatrix * Matrix(vertex));
-            world_c[jVertex] = vertex;
+    // an editing session: frame 0 draws the scene, then every frame turns one object, every fourth moves the light
+    std::unique_ptr<RetainedScene> retained;
+    std::vector<RetainedScene::Stats> retainedStats;
+    if (options.retained) {
+        retained.reset(new RetainedScene(transformMatrix, width, height));
+        std::vector<Instance> placements;
+        instance_grid(*model, options.retained, 1.2f, placements);
+        for (const Instance &placement : placements)
+            retained->add_object(model, placement);
+        retained->set_light(lightDirection);
+    }
 
-            intensity[jVertex] = model->get_norm(iFace, jVertex) * lightDirection;
-            uv[jVertex] = model->get_uv(iFace, jVertex);
-        }
+    if (options.workersSweep) {
+        int status = sort_last_sweep(model, transformMatrix, lightDirection);
+        delete model;
+        return status;
+    }
 
-        triangle(screen_c, uv, intensity, model, image, zBuffer);
+    std::vector<Edge> edges;
+    if (options.wireframe != "off") {
+        edges = unique_edges(model);
+        std::cerr << "# wireframe edges# " << edges.size() << std::endl;
     }
+    double wireframeSeconds = 0;
+    long long edgesDrawn = 0;
+
+    // frame N + 1 is rendered while the writer thread flips and writes frame N
+    // progressive passes and budgeted frames are upscaled straight into the linear image, retained ones copied
+    FrameWriter writer(width, height, std::move(sink), options.writeBuffers,
+                       progressive || budget || retained ? Framebuffer::LINEAR : options.framebufferLayout);
+    FrameArena arena;
+    AllocStats::Counters warmVertex{}, warmRaster{};
+    bool renderFailed = false;
+    auto start = std::chrono::steady_clock::now();
 
-    image.flip_vertically();
-    image.write_tga_file("output.tga");
+    for (int frame = 0; frame < options.frames; ++frame) {
+        Trace::Span frameSpan("frame", frame);
+        // multi-frame runs spin the model around the vertical axis, the light stays fixed in the world
+        Matrix rotation = rotationY(2.f * float(M_PI) * frame / options.frames);
+        Vec3f eye = options.dolly ? dolly_eye(frame, options.frames) : Vec3f(1, 0, 3);
+        Matrix frameTransform = (options.dolly ? camera_transform(eye, Vec3f(0, 0, 0), width, height)
+                                               : transformMatrix) * rotation;
+        Vec3f frameLight = Vec3f(rotation.transpose() * Matrix(lightDirection));
 
-    //Z-Buffer image
-    TGAImage zBufImage(width, height, TGAImage::GRAYSCALE);
+        if (progressive) {
+            int image = frame * imagesPerFrame;
+            ProgressiveRenderer::Stats stats = progressive->render(
+                    frameTransform, frameLight, [&](const Framebuffer &pass, int scale) {
+                        Framebuffer *framebuffer = writer.acquire();
+                        framebuffer->upscale_from(pass);
+                        writer.submit(framebuffer, image++);
+                        if (frame == 0 && scale == 1)
+                            progressiveFinal = pass.color;
+                    });
+            progressiveStats.firstImageSeconds += stats.firstImageSeconds;
+            progressiveStats.totalSeconds += stats.totalSeconds;
+            progressiveStats.fragments += stats.fragments;
+            continue;
+        }
+
+        Framebuffer *framebuffer = writer.acquire();
+        arena.reset();
+        if (streaming) {
+            StreamingRenderer::Stats stats = streamer->render(frameTransform, frameLight, *framebuffer);
+            streamStats.chunks += stats.chunks;
+            streamStats.triangles += stats.triangles;
+            streamStats.culledTriangles += stats.culledTriangles;
+            streamStats.seconds += stats.seconds;
+            streamStats.readWaitSeconds += stats.readWaitSeconds;
+        } else if (options.workers > 1) {
+            SortLastStats stats{};
+            if (!render_sort_last(model, frameTransform, frameLight, *framebuffer, options.workers, stats)) {
+                // a blank or partial frame must not reach the sink
+                writer.release(framebuffer);
+                renderFailed = true;
+                break;
+            }
+            sortLastStats.renderSeconds += stats.renderSeconds;
+            sortLastStats.compositeSeconds += stats.compositeSeconds;
+            sortLastStats.totalSeconds += stats.totalSeconds;
+        } else if (budget) {
+            auto frameStart = std::chrono::steady_clock::now();
+            int32_t w = std::max(1, static_cast<int32_t>(std::lround(width * budget->get_scale())));
+            int32_t h = std::max(1, static_cast<int32_t>(std::lround(height * budget->get_scale())));
+            if (!internal || internal->get_width() != w || internal->get_height() != h)
+                internal.reset(new Framebuffer(w, h, TGAImage::RGB, options.framebufferLayout));
+            else
+                internal->clear();
+            Matrix internalTransform = camera_transform(eye, Vec3f(0, 0, 0), w, h) * rotation;
+            Model *drawn = budget->get_lod() ? budgetLods[budget->get_lod() - 1].get() : model;
+            render(drawn, internalTransform, frameLight, *internal, arena);
+            auto upscaleStart = std::chrono::steady_clock::now();
+            internal->resolve();
+            framebuffer->upscale_from(*internal);
+            budget->frame_done(seconds_since(frameStart), seconds_since(upscaleStart));
+        } else if (retained) {
+            if (frame % 4 == 3) {
+                Matrix turn = rotationY(float(M_PI) / 2 * frame / options.frames);
+                retained->set_light(Vec3f(turn * Matrix(lightDirection)));
+            } else if (frame) {
+                int id = frame * 7 % retained->size();
+                retained->move_object(id, turned(retained->get_placement(id), 20.f));
+            }
+            retainedStats.push_back(retained->update());
+            retained->copy_to(*framebuffer);
+        } else if (instanced) {
+            InstancedRenderer::Stats stats = instanced->render(instances, frameTransform, frameLight, *framebuffer);
+            instancedStats.drawn += stats.drawn;
+            instancedStats.culled += stats.culled;
+            instancedStats.fragments += stats.fragments;
+            instancedStats.seconds += stats.seconds;
+        } else if (lighting) {
+            TiledLighting::Stats stats = lighting->render(model, frameTransform, lights.rotated(rotation), *framebuffer,
+                                                          arena);
+            lightingStats.gbufferSeconds += stats.gbufferSeconds;
+            lightingStats.cullSeconds += stats.cullSeconds;
+            lightingStats.shadeSeconds += stats.shadeSeconds;
+            lightingStats.lightsPerTile += stats.lightsPerTile;
+            lightingStats.lightEvaluations += stats.lightEvaluations;
+        } else if (options.wireframe == "off") {
+            render(model, frameTransform, frameLight, *framebuffer, arena);
+        } else {
+            bool depthTested = options.wireframe == "depth";
+            if (depthTested) {
+                // hidden-line mode: the shaded pass only provides the depth
+                render(model, frameTransform, frameLight, *framebuffer, arena);
+                framebuffer->clear_color();
+            }
+            auto wireframeStart = std::chrono::steady_clock::now();
+            Trace::Span span("wireframe", static_cast<int64_t>(edges.size()));
+            edgesDrawn += wireframe(model, edges, frameTransform, *framebuffer, white, depthTested, arena);
+            wireframeSeconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - wireframeStart).count();
+        }
+        writer.submit(framebuffer, frame);
 
-    for (int i = 0; i < width; ++i) {
-        for (int j = 0; j < height; ++j) {
-            zBufImage.set(i, j, TGAColor(static_cast<uint8_t>(zBuffer[i + j * width])));
+        // the first frame warms up the arena, every frame after it must not touch the heap
+        if (frame == 0) {
+            warmVertex = AllocStats::get(AllocStats::VERTEX);
+            warmRaster = AllocStats::get(AllocStats::RASTER);
         }
     }
+    writer.flush();
+    if (renderFailed) {
+        std::cerr << "Rendering failed, stopped after " << writer.get_written() << " frames\n";
+        delete model;
+        return 1;
+    }
 
-    zBufImage.flip_vertically();
-    zBufImage.write_tga_file("zBuffer.tga");
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "# frames " << options.frames << " in " << seconds << "s, " << options.frames / seconds
+              << " fps, renderer stalled on output for " << writer.get_stall_seconds() << "s" << std::endl;
+    if (options.wireframe != "off")
+        std::cerr << "# wireframe " << edgesDrawn << " edges in " << wireframeSeconds << "s, "
+                  << edgesDrawn / wireframeSeconds << " edges/s" << std::endl;
+    if (options.workers > 1)
+        std::cerr << "# sort-last " << options.workers << " workers: render " << sortLastStats.renderSeconds
+                  << "s, compositing " << sortLastStats.compositeSeconds << "s of " << sortLastStats.totalSeconds
+                  << "s" << std::endl;
+    if (budget) {
+        const std::vector<FrameBudget::Frame> &history = budget->get_history();
+        float minScale = 1, maxScale = 0;
+        double scaleSum = 0, secondsSum = 0;
+        int maxLod = 0;
+        for (size_t i = 0; i < history.size(); ++i) {
+            const FrameBudget::Frame &f = history[i];
+            std::cerr << "# budget frame " << i << ": scale " << f.scale << ", LOD " << f.lod << ", "
+                      << f.seconds * 1000 << "ms " << (f.hit ? "hit" : "MISS") << std::endl;
+            minScale = std::min(minScale, f.scale);
+            maxScale = std::max(maxScale, f.scale);
+            maxLod = std::max(maxLod, f.lod);
+            scaleSum += f.scale;
+            secondsSum += f.seconds;
+        }
+        std::cerr << "# budget " << options.budgetMs << "ms: " << budget->get_hits() << " hits, "
+                  << budget->get_misses() << " misses (" << 100. * budget->get_misses() / history.size()
+                  << "%), scale " << minScale << " to " << maxScale << " (mean " << scaleSum / history.size()
+                  << "), LOD up to " << maxLod << ", mean frame " << secondsSum / history.size() * 1000 << "ms"
+                  << std::endl;
+    }
+    if (lighting)
+        std::cerr << "# lights " << options.lights << " per frame: G-buffer "
+                  << lightingStats.gbufferSeconds / options.frames << "s, culling "
+                  << lightingStats.cullSeconds / options.frames << "s, shading "
+                  << lightingStats.shadeSeconds / options.frames << "s, "
+                  << lightingStats.lightsPerTile / options.frames << " lights per tile, "
+                  << lightingStats.lightEvaluations / options.frames << " light evaluations" << std::endl;
+    if (retained)
+        report_retained(*retained, retainedStats, model);
+    if (instanced)
+        std::cerr << "# instances " << options.instances << " per frame: " << instancedStats.drawn / options.frames
+                  << " drawn, " << instancedStats.culled / options.frames << " culled, "
+                  << instancedStats.fragments / options.frames << " fragments, "
+                  << instancedStats.seconds / options.frames << "s, "
+                  << options.instances * options.frames / instancedStats.seconds << " instances/s, "
+                  << (instanced->scratch_bytes() >> 10) << " KB scratch" << std::endl;
+    if (progressive) {
+        // the same first frame drawn once at full resolution
+        Framebuffer single(width, height, TGAImage::RGB, options.framebufferLayout);
+        arena.reset();
+        auto singleStart = std::chrono::steady_clock::now();
+        long long singleFragments = render(model, transformMatrix, lightDirection, single, arena);
+        single.resolve();
+        double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - singleStart).count();
+        ImageDiff diff = compare_images(single.color, progressiveFinal, 0);
+        std::cerr << "# progressive " << imagesPerFrame << " passes from 1/" << options.progressive
+                  << ": first image after " << progressiveStats.firstImageSeconds / options.frames
+                  << "s, all passes " << progressiveStats.totalSeconds / options.frames << "s, "
+                  << progressiveStats.fragments / options.frames << " fragments per frame, LODs built in "
+                  << progressive->get_lod_seconds() << "s" << std::endl;
+        std::cerr << "# progressive single full resolution render " << singleSeconds << "s, " << singleFragments
+                  << " fragments; final pass differs in " << diff.differingPixels << " pixels (max "
+                  << diff.maxDifference << ")" << std::endl;
+    }
+    if (streaming) {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        std::cerr << "# streaming chunk " << (streamer->get_chunk_triangles() * sizeof(SoupTriangle) >> 10) << " KB ("
+                  << streamer->get_chunk_triangles() << " triangles): " << streamStats.chunks << " chunks, "
+                  << streamStats.triangles / streamStats.seconds << " triangles/s, " << streamStats.culledTriangles
+                  << " culled, waited for the reader " << streamStats.readWaitSeconds << "s, peak RSS "
+                  << usage.ru_maxrss / 1024 << " MB" << std::endl;
+    }
+    AllocStats::report(std::cerr);
+    if (options.frames > 1) {
+        uint64_t steady = AllocStats::get(AllocStats::VERTEX).allocations - warmVertex.allocations +
+                          AllocStats::get(AllocStats::RASTER).allocations - warmRaster.allocations;
+        std::cerr << "# steady-state render allocations: " << steady
+                  << (steady ? " (regression: the render path allocates every frame)" : "") << std::endl;
+    }
+    if (writer.get_failed())
+        std::cerr << "# " << writer.get_failed() << " frames failed to write" << std::endl;
+    if (!options.traceFile.empty() && !Trace::write_json(options.traceFile))
+        return 1;
 
     delete model;
-    delete[] zBuffer;
 
     return 0;
 }